@@ -1,19 +1,31 @@
 #version 330 core
 
 uniform sampler2D tex_2d;
-uniform vec3 sun_position;
-uniform vec3 sun_color;
-uniform vec3 spotlight_position;
-uniform vec3 spotlight_direction;
-uniform vec3 spotlight_color;
-uniform float spotlight_first_cos;
-uniform float spotlight_second_cos;
-uniform float ambient_light_coef ;
-uniform float sun_light_coef;
-uniform float spotlight_coef;
-uniform mat4 m;
-uniform mat4 v;
-uniform mat4 p;
+uniform sampler2D normal_tex;
+uniform sampler2D metallic_roughness_tex;
+uniform vec4 base_color_factor;
+uniform vec2 metallic_roughness_factor;
+uniform float normal_scale;
+
+layout(std140) uniform Camera {
+    mat4 m;
+    mat4 v;
+    mat4 p;
+    vec3 spotlight_position;
+    vec3 spotlight_direction;
+};
+
+layout(std140) uniform Scene {
+    vec3 sun_position;
+    float sun_light_coef;
+    vec3 sun_color;
+    float ambient_light_coef;
+    vec3 spotlight_color;
+    float spotlight_coef;
+    float spotlight_first_cos;
+    float spotlight_second_cos;
+    float morhping_progress;
+};
 
 in vec3 Normal;
 in vec3 position;
@@ -21,8 +33,26 @@ in vec2 vert_tex;
 
 out vec4 out_col;
 
+// tangent frame from screen-space derivatives, the meshes have no tangents
+vec3 perturb_normal(vec3 normal) {
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(vert_tex);
+    vec2 duv2 = dFdy(vert_tex);
+    vec3 dp2perp = cross(dp2, normal);
+    vec3 dp1perp = cross(normal, dp1);
+    vec3 tangent = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 bitangent = dp2perp * duv1.y + dp1perp * duv2.y;
+    float scale = inversesqrt(max(max(dot(tangent, tangent), dot(bitangent, bitangent)), 1e-12));
+
+    vec3 mapped = texture(normal_tex, vert_tex).xyz * 2.0 - 1.0;
+    mapped.xy *= normal_scale;
+    return normalize(mat3(tangent * scale, bitangent * scale, normal) * mapped);
+}
+
 void main() {
-    vec3 normal = normalize(Normal);
+    vec3 normal = perturb_normal(normalize(Normal));
+    vec4 base_color = texture(tex_2d, vert_tex) * base_color_factor;
 
     // calculate sun light
     vec3 sunPosition = vec3(m * vec4(sun_position * 3, 55.0));
@@ -43,5 +73,5 @@ void main() {
     vec3 ambient_light = (ambient_light_coef / 100) * sun_color;
 
     // calculate the result
-    out_col = texture(tex_2d, vert_tex) * vec4(sun_light + spotlight + ambient_light, 0.7);
+    out_col = base_color * vec4(sun_light + spotlight + ambient_light, 0.7);
 }
\ No newline at end of file
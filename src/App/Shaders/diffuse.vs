@@ -3,23 +3,49 @@
 layout(location=0) in vec3 pos;
 layout(location=1) in vec3 in_normal;
 layout(location=2) in vec2 tex;
+// Instance number plus the base instance of the draw, see InstanceBuffer.
+layout(location=3) in uint instance_index;
 
-uniform mat4 m;
-uniform mat4 v;
-uniform mat4 p;
+layout(std140) uniform Camera {
+    mat4 m;
+    mat4 v;
+    mat4 p;
+    vec3 spotlight_position;
+    vec3 spotlight_direction;
+};
 
-uniform float morhping_progress;
+layout(std140) uniform Scene {
+    vec3 sun_position;
+    float sun_light_coef;
+    vec3 sun_color;
+    float ambient_light_coef;
+    vec3 spotlight_color;
+    float spotlight_coef;
+    float spotlight_first_cos;
+    float spotlight_second_cos;
+    float morhping_progress;
+};
+
+// Node to world matrix of every draw, one texel per column, see InstanceBuffer.
+uniform samplerBuffer instance_worlds;
+// Matrix of the first instance of the current draw, 0 for indirect draws.
+uniform uint instance_base;
 
 out vec3 Normal;
 out vec3 position;
 out vec2 vert_tex;
 
 void main() {
-    position = vec3(m * vec4(pos, 1.0));
+    int instance = int(4u * (instance_base + instance_index));
+    mat4 world = mat4(texelFetch(instance_worlds, instance), texelFetch(instance_worlds, instance + 1),
+                      texelFetch(instance_worlds, instance + 2), texelFetch(instance_worlds, instance + 3));
+    mat4 model = m * world;
+    position = vec3(model * vec4(pos, 1.0));
     position = mix(position, normalize(position),  morhping_progress);
     vert_tex = tex;
 
-    Normal = vec3(m * vec4(in_normal, 1.0));
+    // Exact for rotations and uniform scale, which covers glTF scenes in practice.
+    Normal = mat3(model) * in_normal;
     Normal = mix(Normal, normalize(position), morhping_progress);
     gl_Position = p * v * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -1,19 +1,15 @@
 #pragma once
 
-#include "camera.h"
+#include "framescheduler.h"
+#include "frametimes.h"
+#include "renderer.h"
 #include <Base/GLWidget.hpp>
 
 #include <QElapsedTimer>
-#include <QMatrix4x4>
-#include <QOpenGLBuffer>
-#include <QOpenGLShaderProgram>
-#include <QOpenGLTexture>
-#include <QOpenGLVertexArrayObject>
 
-#include <tinygltf/tiny_gltf.h>
-
-#include <functional>
-#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 class Window final : public fgl::GLWidget
 {
@@ -27,49 +23,50 @@ public: // fgl::GLWidget
 	void onRender() override;
 	void onResize(size_t width, size_t height) override;
 
+public:
+	// Starts loading filename, the model shows up once parsed and uploaded.
+	void load(std::string filename);
+	// 0 renders as fast as invalidations arrive.
+	void setMaxFps(double fps);
+	// Redraw every frame even if nothing changed, like a game loop.
+	void setContinuous(bool continuous);
+	// See Renderer::setIndirectDraws.
+	void setIndirectDraws(bool enabled);
+	// See Renderer::setGpuCulling.
+	void setGpuCulling(bool enabled);
+	// See Renderer::setOcclusionCulling.
+	void setOcclusionCulling(bool enabled);
+
 public:
 	constexpr static float MIN_ANGLE = 10;
 	constexpr static float MAX_ANGLE = 100;
-	constexpr static float DEFAULT_ANGLE = 70;
+	constexpr static float DEFAULT_ANGLE = RenderState::g_defaultSpotlightAngle;
 	constexpr static float MIN_COORD = -100;
 	constexpr static float MAX_COORD = 100;
-	constexpr static float DEFAULT_X = 90;
-	constexpr static float DEFAULT_Z = 10;
+	constexpr static float DEFAULT_X = RenderState::g_defaultSunX;
+	constexpr static float DEFAULT_Z = RenderState::g_defaultSunZ;
 	constexpr static float MAX_PROGRESS = 100;
 	constexpr static float MIN_PROGRESS = 0;
 	constexpr static float MAX_SUN = 1000;
-	constexpr static float DEFAULT_SUN = 160;
+	constexpr static float DEFAULT_SUN = RenderState::g_defaultSunCoef;
 	constexpr static float MIN_SUN = 0;
 	constexpr static float MAX_SPOT = 1000;
-	constexpr static float DEFAULT_SPOT = 10;
+	constexpr static float DEFAULT_SPOT = RenderState::g_defaultSpotlightCoef;
 	constexpr static float MIN_SPOT = 0;
 	constexpr static float MAX_AMBIENT = 1000;
-	constexpr static float DEFAULT_AMBIENT = 150;
+	constexpr static float DEFAULT_AMBIENT = RenderState::g_defaultAmbientCoef;
 	constexpr static float MIN_AMBIENT = 0;
 
-
-private:
-	class PerfomanceMetricsGuard final
-	{
-	public:
-		explicit PerfomanceMetricsGuard(std::function<void()> callback);
-		~PerfomanceMetricsGuard();
-
-		PerfomanceMetricsGuard(const PerfomanceMetricsGuard &) = delete;
-		PerfomanceMetricsGuard(PerfomanceMetricsGuard &&) = delete;
-
-		PerfomanceMetricsGuard & operator=(const PerfomanceMetricsGuard &) = delete;
-		PerfomanceMetricsGuard & operator=(PerfomanceMetricsGuard &&) = delete;
-
-	private:
-		std::function<void()> callback_;
-	};
-
-private:
-	[[nodiscard]] PerfomanceMetricsGuard captureMetrics();
-
 signals:
-	void updateFPS(uint);
+	// Emitted at most every few hundred milliseconds while frames are drawn.
+	void updateFrameTimes(FrameTimeStats);
+	void updateScopeTimings(std::vector<GpuTimer::ScopeTiming>);
+	void updateCallStats(GLCallStats, CullStats);
+	void updateLoadingProgress(uint);
+	// Emitted once when the model could not be loaded.
+	void updateLoadingError(QString);
+	// Triangle under the cursor while no button is held, with the time the pick took.
+	void updateHover(std::optional<Picker::Hit>, qint64 pickNs);
 
 public slots:
 	void setLightX(float);
@@ -80,41 +77,16 @@ public slots:
 	void setMorphingProgress(float);
 
 private:
-	Camera camera_;
-
-	GLint mUniform_ = -1, vUniform_ = -1, pUniform_ = -1; // to matrices? struct
-	GLint sunPositionUniform_ = -1; // to light struct
-	GLint sunColorUniform_ = -1;
-	GLint spotlightPositionUniform_ = -1;
-	GLint spotlightColorUniform_ = -1;
-	GLint spotlightDirectionUniform_ = -1;
-	GLint spotlightFirstCosUniform_ = -1, spotlightSecondCosUniform_ = -1; // to vec2
-	GLint spotUniform_ = -1;
-	GLint ambientUniform_ = -1;
-	GLint sunUniform_ = -1;
-	GLint morphingProgressUniform_ = -1;
-
-	float spotlightFirstAngle_ = DEFAULT_ANGLE, spotlightSecondAngle_ = spotlightFirstAngle_ + DEFAULT_ANGLE;
-	QVector3D sunColor_= QVector3D(1.0, 1.0, 1.0), spotlightColor_ = QVector3D(1.0, 1.0, 1.0);
-	QVector3D lightPos = {DEFAULT_X, 2, DEFAULT_Z / 100.f};
-	GLfloat morphingProgress_ = 0;
-	float sun = DEFAULT_SUN, ambient = DEFAULT_AMBIENT, spot = DEFAULT_SPOT;
-
-	QOpenGLBuffer vbo_{QOpenGLBuffer::Type::VertexBuffer};
-	QOpenGLBuffer ibo_{QOpenGLBuffer::Type::IndexBuffer};
-	QOpenGLVertexArrayObject vao_;
-
-	std::unique_ptr<QOpenGLTexture> texture_;
-	std::unique_ptr<QOpenGLShaderProgram> program_;
-
-	tinygltf::Model model_;
-	std::pair<GLuint, std::map<int, GLuint>> vaoAndEbos_;
+	Renderer renderer_;
+	std::string filename_;
 
-	QElapsedTimer timer_;
-	size_t frameCount_ = 0;
-	size_t totalFrameCount_ = 0;
+	FrameTimes frameTimes_;// CPU time of every frame
+	QElapsedTimer sinceStats_;
 
-	bool animated_ = true;
+	bool animated_ = false;
+	bool wasReady_ = false;
+	bool loadErrorShown_ = false;
+	FrameScheduler scheduler_{[this] { update(); }};
 
 protected:
 	void mouseMoveEvent(QMouseEvent* e) override;
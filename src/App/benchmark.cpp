@@ -0,0 +1,271 @@
+#include "benchmark.h"
+#include "frametimes.h"
+#include "renderer.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QSurfaceFormat>
+#include <QTextStream>
+#include <QThread>
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Frames rendered before recording starts, so shader compilation and first-use costs are excluded.
+constexpr size_t g_warmupFrames = 10;
+
+// Orbit of the scripted camera around the origin.
+constexpr float g_orbitRadius = 9.5f;
+constexpr float g_orbitHeight = 1.0f;
+
+struct FrameRecord
+{
+	double cpuMs;
+	double gpuMs;
+	GLCallStats calls;
+	CullStats cull;
+};
+
+// Times of one named GpuTimer scope over the run.
+struct ScopeTimes
+{
+	explicit ScopeTimes(size_t capacity)
+		: cpu{capacity}
+		, gpu{capacity}
+	{
+	}
+
+	FrameTimes cpu;
+	FrameTimes gpu;
+};
+
+using ScopeTimesMap = std::map<std::string, std::unique_ptr<ScopeTimes>>;
+
+void placeCamera(Camera & camera, size_t frame, size_t frameCount)
+{
+	const auto angle = 2.0f * std::numbers::pi_v<float> * static_cast<float>(frame) / static_cast<float>(frameCount);
+	camera.lookAt({g_orbitRadius * std::cos(angle), g_orbitHeight, g_orbitRadius * std::sin(angle)}, {0.0f, 0.0f, 0.0f});
+}
+
+bool writeCsv(QTextStream & out, const std::vector<FrameRecord> & frames)
+{
+	out << "frame,cpu_ms,gpu_ms,draw_calls,triangles,gl_calls,state_changes,redundant_binds,visible_draws,occluded_draws\n";
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const auto & frame = frames[i];
+		out << i << ',' << frame.cpuMs << ',' << frame.gpuMs << ',' << frame.calls.drawCalls << ',' << frame.calls.triangles
+			<< ',' << frame.calls.totalCalls() << ',' << frame.calls.stateChanges << ',' << frame.calls.redundantBinds
+			<< ',' << frame.cull.visible << ',' << frame.cull.occluded << '\n';
+	}
+	return out.status() == QTextStream::Ok;
+}
+
+void writeStats(QTextStream & out, const FrameTimeStats & stats)
+{
+	out << "{\"p50_ms\": " << stats.p50Ms << ", \"p95_ms\": " << stats.p95Ms << ", \"p99_ms\": " << stats.p99Ms
+		<< ", \"max_ms\": " << stats.maxMs << ", \"hitches\": " << stats.hitches << '}';
+}
+
+void printStats(const char * label, const FrameTimeStats & stats)
+{
+	std::cout << "Benchmark: " << label << " ms p50 " << stats.p50Ms << ", p95 " << stats.p95Ms << ", p99 " << stats.p99Ms
+			  << ", max " << stats.maxMs << ", hitches " << stats.hitches << std::endl;
+}
+
+bool writeJson(QTextStream & out, const BenchmarkOptions & options, const Renderer & renderer,
+			   const std::vector<FrameRecord> & frames, const FrameTimeStats & cpuStats, const FrameTimeStats & gpuStats,
+			   const ScopeTimesMap & scopes)
+{
+	out << "{\n";
+	out << "  \"width\": " << options.width << ",\n";
+	out << "  \"height\": " << options.height << ",\n";
+	out << "  \"indirect\": " << (renderer.usesIndirectDraws() ? "true" : "false") << ",\n";
+	out << "  \"gpu_culling\": " << (renderer.usesGpuCulling() ? "true" : "false") << ",\n";
+	out << "  \"summary\": {\"frames\": " << frames.size() << ", \"cpu\": ";
+	writeStats(out, cpuStats);
+	out << ", \"gpu\": ";
+	writeStats(out, gpuStats);
+	out << "},\n";
+	out << "  \"scopes\": {";
+	for (auto it = scopes.begin(); it != scopes.end(); ++it)
+	{
+		out << (it == scopes.begin() ? "\n" : ",\n") << "    \"" << QString::fromStdString(it->first) << "\": {\"cpu\": ";
+		writeStats(out, it->second->cpu.stats());
+		out << ", \"gpu\": ";
+		writeStats(out, it->second->gpu.stats());
+		out << '}';
+	}
+	out << (scopes.empty() ? "},\n" : "\n  },\n");
+	out << "  \"frames\": [\n";
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const auto & frame = frames[i];
+		out << "    {\"frame\": " << i << ", \"cpu_ms\": " << frame.cpuMs << ", \"gpu_ms\": " << frame.gpuMs
+			<< ", \"draw_calls\": " << frame.calls.drawCalls << ", \"triangles\": " << frame.calls.triangles
+			<< ", \"gl_calls\": " << frame.calls.totalCalls() << ", \"state_changes\": " << frame.calls.stateChanges
+			<< ", \"redundant_binds\": " << frame.calls.redundantBinds << ", \"visible_draws\": " << frame.cull.visible
+			<< ", \"occluded_draws\": " << frame.cull.occluded << '}'
+			<< (i + 1 < frames.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+	return out.status() == QTextStream::Ok;
+}
+
+}// namespace
+
+int runBenchmark(const BenchmarkOptions & options)
+{
+	QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+	format.setSamples(0);// the framebuffer object is single-sampled
+
+	QOpenGLContext context;
+	context.setFormat(format);
+	if (!context.create())
+	{
+		std::cout << "Benchmark: failed to create a GL context" << std::endl;
+		return 1;
+	}
+
+	QOffscreenSurface surface;
+	surface.setFormat(context.format());
+	surface.create();
+	if (!surface.isValid() || !context.makeCurrent(&surface))
+	{
+		std::cout << "Benchmark: failed to make an offscreen surface current" << std::endl;
+		return 1;
+	}
+
+	QOpenGLFunctions_3_3_Core funcs;
+	funcs.initializeOpenGLFunctions();
+
+	int exitCode = 0;
+	{
+		QOpenGLFramebufferObject framebuffer(options.width, options.height, QOpenGLFramebufferObject::Depth);
+		framebuffer.bind();
+
+		Renderer renderer;
+		renderer.initialize();
+		renderer.setIndirectDraws(options.indirect);
+		renderer.setGpuCulling(options.gpuCulling);
+		renderer.setOcclusionCulling(options.occlusion);
+		renderer.resize(static_cast<size_t>(options.width), static_cast<size_t>(options.height));
+		renderer.load(options.model.toStdString());
+
+		// Loading frames are not measured, they only drive parsing and uploads.
+		while (!renderer.isReady() && renderer.isLoading())
+		{
+			renderer.render();
+			if (renderer.loadingProgress() == 0.0f)
+			{
+				QThread::msleep(1);
+			}
+		}
+
+		if (!renderer.isReady())
+		{
+			std::cout << "Benchmark: failed to load " << options.model.toStdString() << ": " << renderer.loadError()
+					  << std::endl;
+			exitCode = 1;
+		}
+		else
+		{
+			GLuint query = 0;
+			funcs.glGenQueries(1, &query);
+
+			std::vector<FrameRecord> frames;
+			frames.reserve(options.frames);
+			FrameTimes cpuTimes(options.frames);
+			FrameTimes gpuTimes(options.frames);
+			ScopeTimesMap scopes;
+			uint64_t scopeFrame = 0;
+			for (size_t i = 0; i < g_warmupFrames + options.frames; ++i)
+			{
+				placeCamera(renderer.camera(), i, options.frames);
+
+				QElapsedTimer cpuTimer;
+				cpuTimer.start();
+				funcs.glBeginQuery(GL_TIME_ELAPSED, query);
+				renderer.render();
+				funcs.glEndQuery(GL_TIME_ELAPSED);
+				const auto cpuNs = cpuTimer.nsecsElapsed();
+
+				// Waits for the GPU, which is fine here since CPU time was taken before.
+				GLuint64 gpuNs = 0;
+				funcs.glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNs);
+
+				if (i >= g_warmupFrames)
+				{
+					frames.push_back({static_cast<double>(cpuNs) / 1e6, static_cast<double>(gpuNs) / 1e6,
+									  renderer.frameStats(), renderer.cullStats()});
+					cpuTimes.record(cpuNs);
+					gpuTimes.record(static_cast<int64_t>(gpuNs));
+
+					// Scope timings arrive a few frames late, record each collected frame once.
+					const GpuTimer & gpuTimer = renderer.gpuTimer();
+					if (gpuTimer.resultFrame() != scopeFrame)
+					{
+						scopeFrame = gpuTimer.resultFrame();
+						for (const auto & timing: gpuTimer.results())
+						{
+							auto & times = scopes[timing.name];
+							if (!times)
+							{
+								times = std::make_unique<ScopeTimes>(options.frames);
+							}
+							times->cpu.record(static_cast<int64_t>(timing.cpuMs * 1e6));
+							times->gpu.record(static_cast<int64_t>(timing.gpuMs * 1e6));
+						}
+					}
+				}
+			}
+
+			funcs.glDeleteQueries(1, &query);
+
+			std::cout << "Benchmark: drawn " << (renderer.usesIndirectDraws() ? "with multi-draw indirect" : "per instance run")
+					  << ", culled on the " << (renderer.usesGpuCulling() ? "GPU" : "CPU") << std::endl;
+			const auto cpuStats = cpuTimes.stats();
+			const auto gpuStats = gpuTimes.stats();
+			printStats("CPU", cpuStats);
+			printStats("GPU", gpuStats);
+			for (const auto & [name, times]: scopes)
+			{
+				printStats((name + " CPU").c_str(), times->cpu.stats());
+				printStats((name + " GPU").c_str(), times->gpu.stats());
+			}
+
+			QFile file(options.output);
+			if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+			{
+				std::cout << "Benchmark: failed to open " << options.output.toStdString() << std::endl;
+				exitCode = 1;
+			}
+			else
+			{
+				QTextStream out(&file);
+				const auto ok = options.output.endsWith(".json", Qt::CaseInsensitive)
+					? writeJson(out, options, renderer, frames, cpuStats, gpuStats, scopes)
+					: writeCsv(out, frames);
+				exitCode = ok ? 0 : 1;
+				std::cout << "Benchmark: wrote " << frames.size() << " frames to " << options.output.toStdString() << std::endl;
+			}
+		}
+
+		renderer.release();
+		framebuffer.release();
+	}
+
+	context.doneCurrent();
+	return exitCode;
+}
@@ -0,0 +1,29 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+
+#include <cstddef>
+
+struct BenchmarkOptions
+{
+	QString model;
+	QString output;// .json writes JSON, anything else CSV
+	size_t frames = 300;
+	int width = 800;
+	int height = 800;
+	bool indirect = true;// multi-draw indirect on GL 4.3+, see Renderer::setIndirectDraws
+	bool gpuCulling = true;// compute culling with indirect draws, see Renderer::setGpuCulling
+	bool occlusion = true;// see Renderer::setOcclusionCulling
+};
+
+// Renders options.frames frames of the model into an offscreen framebuffer
+// while the camera orbits it once, and writes CPU time, GPU time and GL call
+// statistics of every frame to options.output, plus CPU and GPU percentiles
+// of the frame and of every GpuTimer scope in JSON and on stdout. Needs no
+// window system beyond a QPA platform that can create an offscreen GL context
+// (e.g. offscreen or xcb under Xvfb, with Mesa llvmpipe). Returns the process
+// exit code.
+int runBenchmark(const BenchmarkOptions & options);
+
+#endif // BENCHMARK_H
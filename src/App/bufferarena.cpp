@@ -0,0 +1,82 @@
+#include "bufferarena.h"
+
+#include <algorithm>
+#include <cassert>
+
+BufferArena::BufferArena(GLCallCounter & funcs, const GLsizeiptr maxBlockSize)
+	: funcs_{funcs}
+	, maxBlockSize_{maxBlockSize}
+{
+}
+
+BufferArena::~BufferArena()
+{
+	assert(blocks_.empty() && "BufferArena::release() must be called with a current context");
+}
+
+void BufferArena::reserve(const GLsizeiptr bytes)
+{
+	pendingBytes_ += bytes;
+}
+
+auto BufferArena::allocate(const GLsizeiptr size, const GLsizeiptr alignment) -> Allocation
+{
+	for (auto & block: blocks_)
+	{
+		const auto offset = (block.used + alignment - 1) / alignment * alignment;
+		if (offset + size <= block.size)
+		{
+			block.used = offset + size;
+			pendingBytes_ = std::max<GLsizeiptr>(0, pendingBytes_ - size);
+			return {block.buffer, offset};
+		}
+	}
+
+	// Size the new block for the rest of the reservation, bounded by
+	// maxBlockSize_ unless a single range is larger than that.
+	const auto blockSize = std::max(size, std::min(pendingBytes_, maxBlockSize_));
+
+	Block block{0, blockSize, size};
+	funcs_.glGenBuffers(1, &block.buffer);
+	// COPY_WRITE_BUFFER does not touch the element binding of the bound VAO.
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, block.buffer);
+	funcs_.glBufferData(GL_COPY_WRITE_BUFFER, blockSize, nullptr, GL_STATIC_DRAW);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	blocks_.push_back(block);
+
+	pendingBytes_ = std::max<GLsizeiptr>(0, pendingBytes_ - size);
+	return {block.buffer, 0};
+}
+
+void BufferArena::upload(const Allocation & allocation, std::span<const unsigned char> bytes)
+{
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+	funcs_.glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset,
+						   static_cast<GLsizeiptr>(bytes.size()), bytes.data());
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferArena::release()
+{
+	for (const auto & block: blocks_)
+	{
+		funcs_.glDeleteBuffers(1, &block.buffer);
+	}
+	blocks_.clear();
+	pendingBytes_ = 0;
+}
+
+size_t BufferArena::blockCount() const
+{
+	return blocks_.size();
+}
+
+GLsizeiptr BufferArena::allocatedBytes() const
+{
+	GLsizeiptr bytes = 0;
+	for (const auto & block: blocks_)
+	{
+		bytes += block.size;
+	}
+	return bytes;
+}
@@ -0,0 +1,58 @@
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include "glcallcounter.h"
+
+#include <span>
+#include <vector>
+
+// Suballocates many small buffer ranges (bufferViews) from a few large GL
+// buffer objects. Draws sharing a block share the binding, so switching
+// between them needs no glBindBuffer at all.
+class BufferArena
+{
+public:
+	struct Allocation
+	{
+		GLuint buffer = 0;
+		GLintptr offset = 0;
+	};
+
+	constexpr static GLsizeiptr DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+	explicit BufferArena(GLCallCounter & funcs, GLsizeiptr maxBlockSize = DEFAULT_BLOCK_SIZE);
+	~BufferArena();
+
+	BufferArena(const BufferArena &) = delete;
+	BufferArena & operator=(const BufferArena &) = delete;
+
+	// Announces how many bytes will be allocated (sizes rounded up to their
+	// alignment), so blocks get sized to fit instead of wasting a full
+	// DEFAULT_BLOCK_SIZE on small scenes.
+	void reserve(GLsizeiptr bytes);
+
+	// Requires a current context, blocks are created on demand.
+	Allocation allocate(GLsizeiptr size, GLsizeiptr alignment);
+	void upload(const Allocation & allocation, std::span<const unsigned char> bytes);
+
+	// Deletes all blocks. Requires a current context.
+	void release();
+
+	[[nodiscard]] size_t blockCount() const;
+	[[nodiscard]] GLsizeiptr allocatedBytes() const;
+
+private:
+	struct Block
+	{
+		GLuint buffer;
+		GLsizeiptr size;
+		GLsizeiptr used;
+	};
+
+	GLCallCounter & funcs_;
+	GLsizeiptr maxBlockSize_;
+	GLsizeiptr pendingBytes_ = 0;
+	std::vector<Block> blocks_;
+};
+
+#endif // BUFFERARENA_H
@@ -0,0 +1,527 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+constexpr size_t g_binCount = 16;
+constexpr uint32_t g_maxLeafSize = 4;
+// Relative cost of visiting a node against testing a box, for the SAH.
+constexpr float g_traversalCost = 1.0f;
+// Extent per axis the SAH sees at most. Unbounded boxes would make every
+// surface area infinite and all splits cost the same; capped low enough that
+// the cost of both sides of 2^32 boxes stays finite, splits that keep the
+// unbounded boxes together remain the cheapest.
+constexpr float g_maxExtent = 1e12f;
+static_assert(2.0f * 3.0f * g_maxExtent * g_maxExtent * 4294967296.0f < FLT_MAX);
+// Below this depth nodes are split at the median instead of by SAH, which
+// bounds the depth of any tree by g_maxDepth (the median halves up to 2^32 boxes).
+constexpr uint32_t g_sahDepth = 32;
+constexpr size_t g_maxDepth = 64;
+
+using Vec3 = std::array<float, 3>;
+
+struct Bounds
+{
+	Vec3 min{FLT_MAX, FLT_MAX, FLT_MAX};
+	Vec3 max{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+	void grow(const Vec3 & point)
+	{
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			min[axis] = std::min(min[axis], point[axis]);
+			max[axis] = std::max(max[axis], point[axis]);
+		}
+	}
+
+	void grow(const Aabb & box)
+	{
+		grow(box.min);
+		grow(box.max);
+	}
+
+	[[nodiscard]] float halfArea() const
+	{
+		if (min[0] > max[0])
+		{
+			return 0.0f;
+		}
+		Vec3 extent;
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			extent[axis] = std::min(max[axis] - min[axis], g_maxExtent);
+		}
+		return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+	}
+};
+
+Vec3 centroid(const Aabb & box)
+{
+	// Halves first, so unbounded boxes sit at the origin instead of overflowing.
+	return {0.5f * box.min[0] + 0.5f * box.max[0], 0.5f * box.min[1] + 0.5f * box.max[1],
+			0.5f * box.min[2] + 0.5f * box.max[2]};
+}
+
+void setBounds(Bvh::Node & node, const Bounds & bounds)
+{
+	node.min = bounds.min;
+	node.max = bounds.max;
+}
+
+struct Split
+{
+	size_t axis = 0;
+	float position = 0.0f;
+	float cost = std::numeric_limits<float>::infinity();
+};
+
+// Pending nodes of a depth-first traversal. Visiting one child and keeping
+// the other leaves at most one entry per level, so a fixed array suffices
+// and queries run every frame or every mouse move never allocate.
+template<typename T>
+class TraversalStack
+{
+public:
+	void push(const T & value)
+	{
+		assert(size_ < items_.size());
+		items_[size_++] = value;
+	}
+
+	[[nodiscard]] T pop()
+	{
+		return items_[--size_];
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return size_ == 0;
+	}
+
+private:
+	std::array<T, g_maxDepth + 2> items_;
+	size_t size_ = 0;
+};
+
+// Evaluates g_binCount - 1 candidate planes per axis over the centroid bounds.
+Split findSplit(const std::vector<Aabb> & boxes, const std::vector<Vec3> & centroids,
+				std::span<const uint32_t> indices)
+{
+	Bounds centroidBounds;
+	for (const auto index: indices)
+	{
+		centroidBounds.grow(centroids[index]);
+	}
+
+	Split best;
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		const auto low = centroidBounds.min[axis];
+		const auto extent = centroidBounds.max[axis] - low;
+		if (!(extent > 0.0f))
+		{
+			continue;
+		}
+
+		std::array<Bounds, g_binCount> bins;
+		std::array<uint32_t, g_binCount> counts{};
+		const auto scale = static_cast<float>(g_binCount) / extent;
+		for (const auto index: indices)
+		{
+			const auto bin = std::min(g_binCount - 1, static_cast<size_t>((centroids[index][axis] - low) * scale));
+			bins[bin].grow(boxes[index]);
+			++counts[bin];
+		}
+
+		// Sweep from the right, then from the left, to get both sides of every plane.
+		std::array<float, g_binCount - 1> rightCost{};
+		Bounds right;
+		uint32_t rightCount = 0;
+		for (size_t i = g_binCount - 1; i > 0; --i)
+		{
+			right.grow(bins[i].min);
+			right.grow(bins[i].max);
+			rightCount += counts[i];
+			rightCost[i - 1] = rightCount ? right.halfArea() * static_cast<float>(rightCount) : 0.0f;
+		}
+
+		Bounds left;
+		uint32_t leftCount = 0;
+		for (size_t i = 0; i + 1 < g_binCount; ++i)
+		{
+			left.grow(bins[i].min);
+			left.grow(bins[i].max);
+			leftCount += counts[i];
+			const auto cost = (leftCount ? left.halfArea() * static_cast<float>(leftCount) : 0.0f) + rightCost[i];
+			if (cost < best.cost)
+			{
+				best = {axis, low + static_cast<float>(i + 1) / scale, cost};
+			}
+		}
+	}
+	return best;
+}
+
+bool outside(const Frustum & frustum, const Vec3 & min, const Vec3 & max)
+{
+	for (const auto & plane: frustum.planes)
+	{
+		const auto x = plane[0] > 0.0f ? max[0] : min[0];
+		const auto y = plane[1] > 0.0f ? max[1] : min[1];
+		const auto z = plane[2] > 0.0f ? max[2] : min[2];
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool inside(const Frustum & frustum, const Vec3 & min, const Vec3 & max)
+{
+	for (const auto & plane: frustum.planes)
+	{
+		const auto x = plane[0] > 0.0f ? min[0] : max[0];
+		const auto y = plane[1] > 0.0f ? min[1] : max[1];
+		const auto z = plane[2] > 0.0f ? min[2] : max[2];
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Entry distance of the ray into the box, or infinity if it misses it before maxDistance.
+float rayEntry(const Vec3 & origin, const Vec3 & inverseDirection, const Vec3 & min, const Vec3 & max,
+			   const float maxDistance)
+{
+	auto entry = 0.0f;
+	auto exit = maxDistance;
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		auto t0 = (min[axis] - origin[axis]) * inverseDirection[axis];
+		auto t1 = (max[axis] - origin[axis]) * inverseDirection[axis];
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+		// NaN from 0 * inf (origin on a slab of a parallel axis) must not shrink the interval.
+		entry = t0 > entry ? t0 : entry;
+		exit = t1 < exit ? t1 : exit;
+	}
+	return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+}
+
+float squaredDistance(const Vec3 & point, const Vec3 & min, const Vec3 & max)
+{
+	auto result = 0.0f;
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		const auto d = std::max({min[axis] - point[axis], 0.0f, point[axis] - max[axis]});
+		result += d * d;
+	}
+	return result;
+}
+
+}// namespace
+
+void Bvh::build(const BoxList & boxList)
+{
+	clear();
+	const auto count = static_cast<uint32_t>(boxList.size());
+	if (count == 0)
+	{
+		return;
+	}
+
+	std::vector<Aabb> boxes(count);
+	std::vector<Vec3> centroids(count);
+	indices_.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		boxes[i] = boxList.box(i);
+		centroids[i] = centroid(boxes[i]);
+		indices_[i] = i;
+	}
+
+	nodes_.reserve(2 * static_cast<size_t>(count));
+	nodes_.push_back({{}, 0, {}, count});
+
+	std::vector<std::pair<uint32_t, uint32_t>> pending{{0, 0}};// node and depth
+	while (!pending.empty())
+	{
+		const auto [nodeIndex, depth] = pending.back();
+		pending.pop_back();
+
+		const auto first = nodes_[nodeIndex].first;
+		const auto size = nodes_[nodeIndex].count;
+		const std::span<uint32_t> range(indices_.data() + first, size);
+
+		Bounds bounds;
+		for (const auto index: range)
+		{
+			bounds.grow(boxes[index]);
+		}
+		setBounds(nodes_[nodeIndex], bounds);
+
+		if (size <= 1)
+		{
+			continue;
+		}
+
+		const auto split = findSplit(boxes, centroids, range);
+		const auto leafCost = bounds.halfArea() * static_cast<float>(size);
+		if (size <= g_maxLeafSize && !(split.cost + g_traversalCost * bounds.halfArea() < leafCost))
+		{
+			continue;
+		}
+
+		auto middle = range.begin() + size / 2;
+		if (depth >= g_sahDepth)
+		{
+			std::nth_element(range.begin(), middle, range.end(), [&](const uint32_t a, const uint32_t b) {
+				return centroids[a][split.axis] < centroids[b][split.axis];
+			});
+		}
+		else
+		{
+			middle = std::partition(range.begin(), range.end(), [&](const uint32_t index) {
+				return centroids[index][split.axis] < split.position;
+			});
+			// Identical centroids (or no usable plane): halve the range to keep the tree bounded.
+			if (middle == range.begin() || middle == range.end())
+			{
+				middle = range.begin() + size / 2;
+			}
+		}
+		const auto leftCount = static_cast<uint32_t>(middle - range.begin());
+
+		const auto left = static_cast<uint32_t>(nodes_.size());
+		nodes_.push_back({{}, first, {}, leftCount});
+		nodes_.push_back({{}, first + leftCount, {}, size - leftCount});
+		nodes_[nodeIndex].first = left;
+		nodes_[nodeIndex].count = 0;
+		pending.push_back({left + 1, depth + 1});
+		pending.push_back({left, depth + 1});
+	}
+
+	boxes_.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		boxes_[i] = boxes[indices_[i]];
+	}
+}
+
+void Bvh::refit(const BoxList & boxes)
+{
+	assert(boxes.size() == indices_.size());
+	for (auto i = nodes_.size(); i-- > 0;)
+	{
+		Node & node = nodes_[i];
+		Bounds bounds;
+		if (node.count > 0)
+		{
+			for (uint32_t j = node.first; j < node.first + node.count; ++j)
+			{
+				boxes_[j] = boxes.box(indices_[j]);
+				bounds.grow(boxes_[j]);
+			}
+		}
+		else
+		{
+			for (const auto child: {node.first, node.first + 1})
+			{
+				bounds.grow(nodes_[child].min);
+				bounds.grow(nodes_[child].max);
+			}
+		}
+		setBounds(node, bounds);
+	}
+}
+
+void Bvh::clear()
+{
+	nodes_.clear();
+	indices_.clear();
+	boxes_.clear();
+}
+
+void Bvh::cullFrustum(const Frustum & frustum, std::span<uint8_t> visible) const
+{
+	assert(visible.size() >= indices_.size());
+	std::fill_n(visible.begin(), indices_.size(), uint8_t{0});
+	if (nodes_.empty())
+	{
+		return;
+	}
+
+	// Nodes whose whole subtree is known to be inside carry a set flag.
+	TraversalStack<std::pair<uint32_t, bool>> pending;
+	pending.push({0, false});
+	while (!pending.empty())
+	{
+		const auto [nodeIndex, accepted] = pending.pop();
+		const Node & node = nodes_[nodeIndex];
+
+		auto contained = accepted;
+		if (!contained)
+		{
+			if (outside(frustum, node.min, node.max))
+			{
+				continue;
+			}
+			contained = inside(frustum, node.min, node.max);
+		}
+
+		if (node.count == 0)
+		{
+			pending.push({node.first + 1, contained});
+			pending.push({node.first, contained});
+			continue;
+		}
+
+		// A leaf box is tested on its own unless the leaf is wholly inside.
+		if (contained)
+		{
+			for (uint32_t j = node.first; j < node.first + node.count; ++j)
+			{
+				visible[indices_[j]] = 1;
+			}
+			continue;
+		}
+		for (uint32_t j = node.first; j < node.first + node.count; ++j)
+		{
+			visible[indices_[j]] = outside(frustum, boxes_[j].min, boxes_[j].max) ? 0 : 1;
+		}
+	}
+}
+
+void Bvh::intersectRay(const Ray & ray, float maxDistance, const RayCallback & hit) const
+{
+	if (nodes_.empty())
+	{
+		return;
+	}
+
+	Vec3 inverseDirection;
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		inverseDirection[axis] = 1.0f / ray.direction[axis];
+	}
+
+	TraversalStack<std::pair<uint32_t, float>> pending;
+	const auto rootEntry = rayEntry(ray.origin, inverseDirection, nodes_[0].min, nodes_[0].max, maxDistance);
+	if (std::isinf(rootEntry))
+	{
+		return;
+	}
+	pending.push({0, rootEntry});
+
+	while (!pending.empty())
+	{
+		const auto [nodeIndex, entry] = pending.pop();
+		if (entry > maxDistance)
+		{
+			continue;
+		}
+
+		const Node & node = nodes_[nodeIndex];
+		if (node.count > 0)
+		{
+			for (uint32_t j = node.first; j < node.first + node.count; ++j)
+			{
+				const auto boxEntry = rayEntry(ray.origin, inverseDirection, boxes_[j].min, boxes_[j].max, maxDistance);
+				if (!std::isinf(boxEntry))
+				{
+					maxDistance = std::min(maxDistance, hit(indices_[j], boxEntry));
+				}
+			}
+			continue;
+		}
+
+		// Push the farther child first so the nearer one is visited next.
+		const auto & left = nodes_[node.first];
+		const auto & right = nodes_[node.first + 1];
+		const auto leftEntry = rayEntry(ray.origin, inverseDirection, left.min, left.max, maxDistance);
+		const auto rightEntry = rayEntry(ray.origin, inverseDirection, right.min, right.max, maxDistance);
+		const bool leftFirst = leftEntry <= rightEntry;
+		const std::array<std::pair<uint32_t, float>, 2> children{{
+			{leftFirst ? node.first + 1 : node.first, leftFirst ? rightEntry : leftEntry},
+			{leftFirst ? node.first : node.first + 1, leftFirst ? leftEntry : rightEntry}}};
+		for (const auto & child: children)
+		{
+			if (!std::isinf(child.second))
+			{
+				pending.push(child);
+			}
+		}
+	}
+}
+
+auto Bvh::nearest(const std::array<float, 3> & point, const float maxDistance) const -> std::optional<Nearest>
+{
+	if (nodes_.empty())
+	{
+		return std::nullopt;
+	}
+
+	std::optional<Nearest> best;
+	auto bestSquared = maxDistance * maxDistance;
+
+	TraversalStack<std::pair<uint32_t, float>> pending;
+	pending.push({0, squaredDistance(point, nodes_[0].min, nodes_[0].max)});
+	while (!pending.empty())
+	{
+		const auto [nodeIndex, distance] = pending.pop();
+		if (distance > bestSquared)
+		{
+			continue;
+		}
+
+		const Node & node = nodes_[nodeIndex];
+		if (node.count > 0)
+		{
+			for (uint32_t j = node.first; j < node.first + node.count; ++j)
+			{
+				const auto boxDistance = squaredDistance(point, boxes_[j].min, boxes_[j].max);
+				if (boxDistance <= bestSquared)
+				{
+					best = Nearest{indices_[j], std::sqrt(boxDistance)};
+					bestSquared = boxDistance;
+				}
+			}
+			continue;
+		}
+
+		const auto leftDistance = squaredDistance(point, nodes_[node.first].min, nodes_[node.first].max);
+		const auto rightDistance = squaredDistance(point, nodes_[node.first + 1].min, nodes_[node.first + 1].max);
+		if (leftDistance <= rightDistance)
+		{
+			pending.push({node.first + 1, rightDistance});
+			pending.push({node.first, leftDistance});
+		}
+		else
+		{
+			pending.push({node.first, leftDistance});
+			pending.push({node.first + 1, rightDistance});
+		}
+	}
+	return best;
+}
+
+bool Bvh::empty() const
+{
+	return nodes_.empty();
+}
+
+auto Bvh::nodes() const -> std::span<const Node>
+{
+	return nodes_;
+}
@@ -0,0 +1,71 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "frustumculling.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct Ray
+{
+	std::array<float, 3> origin;
+	std::array<float, 3> direction;// need not be normalized, distances are in its units
+};
+
+// Bounding volume hierarchy over a BoxList, built with binned SAH into one
+// flat node array. Siblings are adjacent and children always follow their
+// parent, so traversal walks forward through memory and refit is a single
+// backwards pass. Queries report box indices of the BoxList it was built from.
+// Deep SAH paths fall back to median splits, so the depth is bounded and
+// queries traverse with a fixed-size stack.
+class Bvh
+{
+public:
+	// 32 bytes, two per cache line.
+	struct Node
+	{
+		std::array<float, 3> min;
+		uint32_t first;// leaf: first entry of the index array, inner: left child (right is first + 1)
+		std::array<float, 3> max;
+		uint32_t count;// boxes of a leaf, 0 for inner nodes
+	};
+
+	struct Nearest
+	{
+		uint32_t index;
+		float distance;
+	};
+
+	// Called for every box the ray enters before the current maximum distance,
+	// nearer subtrees first, with the entry distance. Returns the new maximum,
+	// e.g. the distance of a confirmed hit inside the box, to prune the rest.
+	using RayCallback = std::function<float(uint32_t index, float entry)>;
+
+	void build(const BoxList & boxes);
+	// Recomputes the node bounds after boxes moved. The topology stays, so
+	// the tree degrades if they moved a lot; rebuild then.
+	void refit(const BoxList & boxes);
+	void clear();
+
+	// Same result as cullBoxes, but skips subtrees entirely outside and
+	// accepts subtrees entirely inside without testing their boxes.
+	void cullFrustum(const Frustum & frustum, std::span<uint8_t> visible) const;
+	void intersectRay(const Ray & ray, float maxDistance, const RayCallback & hit) const;
+	// Box closest to point within maxDistance, by distance to the box (0 inside it).
+	[[nodiscard]] std::optional<Nearest> nearest(const std::array<float, 3> & point, float maxDistance) const;
+
+	[[nodiscard]] bool empty() const;
+	[[nodiscard]] std::span<const Node> nodes() const;
+
+private:
+	std::vector<Node> nodes_;
+	std::vector<uint32_t> indices_;// box indices, leaves reference ranges of it
+	std::vector<Aabb> boxes_;// copy of the boxes in indices_ order, so leaves read them contiguously
+};
+
+#endif // BVH_H
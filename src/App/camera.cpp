@@ -1,4 +1,5 @@
 #include "camera.h"
+#include "trace.h"
 
 #include <App/thirdparty/glm/glm/glm.hpp>
 #include <App/thirdparty/glm/glm/ext.hpp>
@@ -22,8 +23,10 @@ QVector3D toQVec3(glm::vec3 in) {
 
 std::tuple<QMatrix4x4, QMatrix4x4, QMatrix4x4, QVector3D> Camera::update(float fovd, float near, float far, size_t totalFrameCount_)
 {
+	TRACE_SCOPE("Camera::update");
 	// Calculate MVP matrix
 	model.setToIdentity();
+	dirty = false;
 
 	glm::vec3 glmOrientation = toGLMVec3(orientation);
 	glm::vec3 glmUp = toGLMVec3(up);
@@ -41,6 +44,11 @@ std::tuple<QMatrix4x4, QMatrix4x4, QMatrix4x4, QVector3D> Camera::update(float f
 
 	// view.translate(position);
 
+	// The view above still uses the old position, recompute it next frame.
+	if (!movement.isNull())
+	{
+		dirty = true;
+	}
 	position += movement.z() * orientation;
 	position += movement.x() * newRight;
 	position += {0.0, movement.y(), 0.0};
@@ -69,13 +77,27 @@ void Camera::input(QMouseEvent *event)
 		cord = {static_cast<float>(event->x()), static_cast<float>(event->y())};
 		rotationX += change.x() * 0.01;
 		orientation += QVector3D{0.0f, change.y(), -change.x()} * 0.01;
+		dirty = true;
 	}
 }
 
 void Camera::resize(size_t width, size_t height)
 {
+	this->width = width;
+	this->height = height;
 	this->aspect = static_cast<float>(width) / static_cast<float>(height);
+	dirty = true;
 }
+void Camera::lookAt(QVector3D position, QVector3D target)
+{
+	this->position = position;
+	orientation = (target - position).normalized();
+	rotationX = 0.0f;
+	rotationY = 0.0f;
+	movement = {0.0f, 0.0f, 0.0f};
+	dirty = true;
+}
+
 void Camera::wheelEvent(QWheelEvent * event)
 {
 	if (event->angleDelta().y() > 0) {
@@ -83,4 +105,5 @@ void Camera::wheelEvent(QWheelEvent * event)
 	} else if (event->angleDelta().y() < 0) {
 		movement += {0.0, 0.0, 3 * -speed};
 	}
+	dirty = true;
 }
@@ -13,7 +13,7 @@ public:
 	QVector3D up{0.0f, 2.0f, 0.0f};
 	QVector3D right{1.0f, 0.0f, 0.0f};
 
-	size_t width, height;
+	size_t width = 0, height = 0;
 
 	QVector3D localOrientation{1.0f, 0.0f, -1.0f};
 	float rotationX = 0, rotationY = 100;
@@ -24,6 +24,9 @@ public:
 
 	float aspect = 1.0f;
 
+	// Set by input and resize, cleared by update() once the matrices are current.
+	bool dirty = true;
+
 	float speed = 0.1f;
 	float sensitivity = 0.1f;
 
@@ -38,6 +41,8 @@ public:
 	void input(QMouseEvent* event);
 	void wheelEvent(QWheelEvent *event);
 	void resize(size_t width, size_t height);
+	// Places the camera at position looking at target, dropping pending input.
+	void lookAt(QVector3D position, QVector3D target);
 	void mousePressEvent(QMouseEvent * event);
 };
 
@@ -0,0 +1,200 @@
+#include "depthpyramid.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+// Threads per work group along x and y, local_size of hiz.comp.
+constexpr GLuint g_groupSize = 8;
+
+// Internal format a depth attachment can be blitted into, they have to match.
+GLenum depthFormat(QOpenGLFunctions_4_3_Core & funcs, const GLuint framebuffer)
+{
+	const GLenum depth = framebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+	const GLenum stencil = framebuffer == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+	GLint depthBits = 0;
+	GLint componentType = 0;
+	funcs.glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+	funcs.glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE,
+												&componentType);
+	// Sizes of an attachment point without attachment cannot be queried.
+	GLint stencilType = GL_NONE;
+	GLint stencilBits = 0;
+	funcs.glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencil, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE,
+												&stencilType);
+	if (stencilType != GL_NONE)
+	{
+		funcs.glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencil, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE,
+													&stencilBits);
+	}
+	if (componentType == GL_FLOAT)
+	{
+		return stencilBits > 0 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+	}
+	if (stencilBits > 0)
+	{
+		return GL_DEPTH24_STENCIL8;
+	}
+	return depthBits == 16 ? GL_DEPTH_COMPONENT16 : depthBits == 32 ? GL_DEPTH_COMPONENT32 : GL_DEPTH_COMPONENT24;
+}
+
+}// namespace
+
+DepthPyramid::DepthPyramid(QOpenGLFunctions_4_3_Core & funcs)
+	: funcs_{funcs}
+{
+}
+
+DepthPyramid::~DepthPyramid()
+{
+	assert(pyramid_ == 0 && "DepthPyramid::release() must be called with a current context");
+}
+
+bool DepthPyramid::create()
+{
+	program_ = std::make_unique<QOpenGLShaderProgram>();
+	if (!program_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/Shaders/hiz.comp") || !program_->link())
+	{
+		program_.reset();
+		return false;
+	}
+	sourceLevelUniform_ = program_->uniformLocation("source_level");
+	program_->bind();
+	program_->setUniformValue("source", 0);
+	program_->release();
+
+	funcs_.glGenFramebuffers(1, &depthFramebuffer_);
+	return true;
+}
+
+void DepthPyramid::release()
+{
+	program_.reset();
+	if (depthFramebuffer_ != 0)
+	{
+		funcs_.glDeleteFramebuffers(1, &depthFramebuffer_);
+		depthFramebuffer_ = 0;
+	}
+	for (GLuint * texture: {&depthTexture_, &pyramid_})
+	{
+		if (*texture != 0)
+		{
+			funcs_.glDeleteTextures(1, texture);
+			*texture = 0;
+		}
+	}
+	depthFormat_ = 0;
+	width_ = 0;
+	height_ = 0;
+	levels_ = 0;
+	valid_ = false;
+}
+
+void DepthPyramid::allocate(const GLuint framebuffer, const GLsizei width, const GLsizei height)
+{
+	const auto format = depthFormat(funcs_, framebuffer);
+	if (format == depthFormat_ && width == width_ && height == height_)
+	{
+		return;
+	}
+	depthFormat_ = format;
+	width_ = width;
+	height_ = height;
+
+	for (GLuint * texture: {&depthTexture_, &pyramid_})
+	{
+		if (*texture != 0)
+		{
+			funcs_.glDeleteTextures(1, texture);
+		}
+		funcs_.glGenTextures(1, texture);
+	}
+
+	funcs_.glBindTexture(GL_TEXTURE_2D, depthTexture_);
+	funcs_.glTexStorage2D(GL_TEXTURE_2D, 1, depthFormat_, width_, height_);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	funcs_.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer_);
+	const GLenum attachment = depthFormat_ == GL_DEPTH24_STENCIL8 || depthFormat_ == GL_DEPTH32F_STENCIL8
+		? GL_DEPTH_STENCIL_ATTACHMENT
+		: GL_DEPTH_ATTACHMENT;
+	funcs_.glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, depthTexture_, 0);
+
+	const auto levelWidth = std::max(1, width_ / 2);
+	const auto levelHeight = std::max(1, height_ / 2);
+	levels_ = 1;
+	while ((levelWidth >> levels_) > 0 || (levelHeight >> levels_) > 0)
+	{
+		++levels_;
+	}
+	funcs_.glBindTexture(GL_TEXTURE_2D, pyramid_);
+	funcs_.glTexStorage2D(GL_TEXTURE_2D, levels_, GL_R32F, levelWidth, levelHeight);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	funcs_.glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void DepthPyramid::build(const GLuint framebuffer, const GLsizei width, const GLsizei height, const Matrix & viewProjection)
+{
+	TRACE_SCOPE("DepthPyramid::build");
+	funcs_.glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	allocate(framebuffer, width, height);
+
+	// Resolves multisampled depth as well, the formats match by construction.
+	funcs_.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer_);
+	funcs_.glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	funcs_.glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	program_->bind();
+	funcs_.glActiveTexture(GL_TEXTURE0);
+	for (GLint level = 0; level < levels_; ++level)
+	{
+		// Level 0 reads the depth copy, every further level the one before.
+		funcs_.glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture_ : pyramid_);
+		funcs_.glUniform1i(sourceLevelUniform_, level == 0 ? 0 : level - 1);
+		funcs_.glBindImageTexture(0, pyramid_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		const auto levelWidth = static_cast<GLuint>(std::max(1, (width_ / 2) >> level));
+		const auto levelHeight = static_cast<GLuint>(std::max(1, (height_ / 2) >> level));
+		funcs_.glDispatchCompute((levelWidth + g_groupSize - 1) / g_groupSize, (levelHeight + g_groupSize - 1) / g_groupSize, 1);
+		funcs_.glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	funcs_.glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	funcs_.glBindTexture(GL_TEXTURE_2D, 0);
+	program_->release();
+
+	viewProjection_ = viewProjection;
+	valid_ = true;
+}
+
+void DepthPyramid::invalidate()
+{
+	valid_ = false;
+}
+
+bool DepthPyramid::isValid() const
+{
+	return valid_;
+}
+
+GLuint DepthPyramid::texture() const
+{
+	return pyramid_;
+}
+
+GLint DepthPyramid::levels() const
+{
+	return levels_;
+}
+
+std::array<GLint, 2> DepthPyramid::viewport() const
+{
+	return {width_, height_};
+}
+
+const DepthPyramid::Matrix & DepthPyramid::viewProjection() const
+{
+	return viewProjection_;
+}
@@ -0,0 +1,67 @@
+#ifndef DEPTHPYRAMID_H
+#define DEPTHPYRAMID_H
+
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include <array>
+#include <memory>
+
+// Hierarchical depth of a rendered frame for occlusion tests, on GL 4.3+.
+// The depth buffer is resolved into a texture and reduced to an R32F mip
+// chain where every texel holds the farthest depth of the 2x2 texels below
+// (the last row and column also cover what odd sizes leave over). Level 0
+// is half the viewport, so pixel p lies in texel min(p >> (l + 1), size - 1)
+// of level l. A box whose nearest depth is behind all texels covering its
+// screen rectangle was hidden when the frame was drawn.
+class DepthPyramid
+{
+public:
+	using Matrix = std::array<float, 16>;// column-major
+
+	explicit DepthPyramid(QOpenGLFunctions_4_3_Core & funcs);
+	~DepthPyramid();
+
+	DepthPyramid(const DepthPyramid &) = delete;
+	DepthPyramid & operator=(const DepthPyramid &) = delete;
+
+	// Compiles the reduction shader. Requires a current context, returns
+	// false if it does not compile.
+	bool create();
+	// Deletes all GL objects. Requires a current context.
+	void release();
+
+	// Reduces the depth buffer of framebuffer, width x height pixels and
+	// possibly multisampled, drawn with viewProjection. Binds through funcs,
+	// past any state cache, and restores the framebuffer bindings.
+	void build(GLuint framebuffer, GLsizei width, GLsizei height, const Matrix & viewProjection);
+	// Forgets the last build, e.g. after a new scene was loaded.
+	void invalidate();
+
+	// True once build() ran since the last invalidate().
+	[[nodiscard]] bool isValid() const;
+	[[nodiscard]] GLuint texture() const;
+	[[nodiscard]] GLint levels() const;
+	[[nodiscard]] std::array<GLint, 2> viewport() const;
+	[[nodiscard]] const Matrix & viewProjection() const;
+
+private:
+	// (Re)allocates the textures for the size and depth format of framebuffer.
+	void allocate(GLuint framebuffer, GLsizei width, GLsizei height);
+
+	QOpenGLFunctions_4_3_Core & funcs_;
+	std::unique_ptr<QOpenGLShaderProgram> program_;
+	GLint sourceLevelUniform_ = -1;
+
+	GLuint depthTexture_ = 0;// single-sampled copy of the depth buffer
+	GLuint depthFramebuffer_ = 0;
+	GLuint pyramid_ = 0;
+	GLenum depthFormat_ = 0;
+	GLsizei width_ = 0;
+	GLsizei height_ = 0;
+	GLint levels_ = 0;
+	Matrix viewProjection_{};
+	bool valid_ = false;
+};
+
+#endif // DEPTHPYRAMID_H
@@ -0,0 +1,54 @@
+#include "framescheduler.h"
+
+#include <cmath>
+
+FrameScheduler::FrameScheduler(std::function<void()> requestFrame)
+	: requestFrame_{std::move(requestFrame)}
+{
+	deferred_.setSingleShot(true);
+	deferred_.setTimerType(Qt::PreciseTimer);
+	QObject::connect(&deferred_, &QTimer::timeout, [this] { requestFrame_(); });
+}
+
+void FrameScheduler::setMaxFps(const double fps)
+{
+	minIntervalNs_ = fps > 0.0 ? static_cast<qint64>(std::round(1e9 / fps)) : 0;
+}
+
+void FrameScheduler::setAnimating(const bool animating)
+{
+	animating_ = animating;
+	if (animating_)
+	{
+		invalidate();
+	}
+}
+
+void FrameScheduler::invalidate()
+{
+	if (pending_)
+	{
+		return;
+	}
+	pending_ = true;
+
+	const auto elapsedNs = sinceFrame_.isValid() ? sinceFrame_.nsecsElapsed() : minIntervalNs_;
+	if (elapsedNs >= minIntervalNs_)
+	{
+		requestFrame_();
+		return;
+	}
+
+	// Round up so the deferred request never fires early.
+	deferred_.start(static_cast<int>((minIntervalNs_ - elapsedNs + 999'999) / 1'000'000));
+}
+
+void FrameScheduler::beginFrame()
+{
+	pending_ = false;
+	sinceFrame_.start();
+	if (animating_)
+	{
+		invalidate();
+	}
+}
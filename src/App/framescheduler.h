@@ -0,0 +1,40 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <functional>
+
+// Requests a redraw only when something invalidated the frame: input, a
+// slider, pending uploads or a running animation. Requests between frames are
+// coalesced, and with a frame-rate cap a request arriving too early is
+// deferred until the interval since the last frame has passed.
+class FrameScheduler
+{
+public:
+	explicit FrameScheduler(std::function<void()> requestFrame);
+
+	FrameScheduler(const FrameScheduler &) = delete;
+	FrameScheduler & operator=(const FrameScheduler &) = delete;
+
+	// 0 disables the cap.
+	void setMaxFps(double fps);
+	// While animating every frame invalidates the next one.
+	void setAnimating(bool animating);
+
+	void invalidate();
+
+	// Call at the start of every frame, invalidations after it schedule the next one.
+	void beginFrame();
+
+private:
+	std::function<void()> requestFrame_;
+	QTimer deferred_;
+	QElapsedTimer sinceFrame_;
+	qint64 minIntervalNs_ = 0;
+	bool pending_ = false;
+	bool animating_ = false;
+};
+
+#endif // FRAMESCHEDULER_H
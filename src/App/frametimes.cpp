@@ -0,0 +1,86 @@
+#include "frametimes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+// A frame counts as a hitch when it takes more than this many times the median.
+constexpr double g_hitchFactor = 2.0;
+
+// Nearest-rank percentile of sorted samples.
+int64_t percentile(const std::vector<int64_t> & sorted, const double p)
+{
+	const auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+	return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+double toMs(const int64_t ns)
+{
+	return static_cast<double>(ns) / 1e6;
+}
+
+}// namespace
+
+FrameTimes::FrameTimes(const size_t capacity)
+	: capacity_{std::max<size_t>(1, capacity)}
+	, samples_{std::make_unique<std::atomic<int64_t>[]>(capacity_)}
+{
+}
+
+void FrameTimes::record(const int64_t durationNs)
+{
+	const auto head = head_.load(std::memory_order_relaxed);
+	samples_[head % capacity_].store(durationNs, std::memory_order_relaxed);
+	head_.store(head + 1, std::memory_order_release);
+}
+
+FrameTimeStats FrameTimes::stats(const size_t window) const
+{
+	const auto head = head_.load(std::memory_order_acquire);
+	auto count = static_cast<size_t>(std::min<uint64_t>({head, capacity_, window}));
+
+	std::vector<int64_t> samples(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		samples[i] = samples_[(head - count + i) % capacity_].load(std::memory_order_relaxed);
+	}
+
+	// The oldest samples may have been replaced by frames recorded while copying, drop them.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const auto written = head_.load(std::memory_order_relaxed) - head;
+	const auto free = capacity_ - count;
+	const auto overwritten = written > free ? static_cast<size_t>(std::min<uint64_t>(written - free, count)) : 0;
+	samples.erase(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(overwritten));
+	count = samples.size();
+
+	FrameTimeStats stats;
+	if (count == 0)
+	{
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	const auto median = percentile(samples, 0.50);
+	const auto hitchNs = static_cast<int64_t>(g_hitchFactor * static_cast<double>(median));
+
+	stats.frames = count;
+	stats.p50Ms = toMs(median);
+	stats.p95Ms = toMs(percentile(samples, 0.95));
+	stats.p99Ms = toMs(percentile(samples, 0.99));
+	stats.maxMs = toMs(samples.back());
+	stats.hitches = static_cast<size_t>(samples.end() - std::upper_bound(samples.begin(), samples.end(), hitchNs));
+	return stats;
+}
+
+size_t FrameTimes::capacity() const
+{
+	return capacity_;
+}
+
+uint64_t FrameTimes::count() const
+{
+	return head_.load(std::memory_order_acquire);
+}
@@ -0,0 +1,48 @@
+#ifndef FRAMETIMES_H
+#define FRAMETIMES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Percentiles of the frame durations in a window, in milliseconds.
+struct FrameTimeStats
+{
+	size_t frames = 0;
+	double p50Ms = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	double maxMs = 0.0;
+	// Frames that took more than twice as long as the median.
+	size_t hitches = 0;
+};
+
+// Ring buffer of the last `capacity` frame durations. One thread records,
+// any thread may compute statistics without locking: a reader copies the
+// samples and drops those the writer overwrote meanwhile.
+class FrameTimes
+{
+public:
+	explicit FrameTimes(size_t capacity);
+
+	FrameTimes(const FrameTimes &) = delete;
+	FrameTimes & operator=(const FrameTimes &) = delete;
+
+	// Only one thread may record.
+	void record(int64_t durationNs);
+
+	// Statistics over the most recent min(window, capacity) frames.
+	[[nodiscard]] FrameTimeStats stats(size_t window = SIZE_MAX) const;
+
+	[[nodiscard]] size_t capacity() const;
+	// Frames recorded since construction, including overwritten ones.
+	[[nodiscard]] uint64_t count() const;
+
+private:
+	size_t capacity_;
+	std::unique_ptr<std::atomic<int64_t>[]> samples_;
+	std::atomic<uint64_t> head_{0};// index of the next write
+};
+
+#endif // FRAMETIMES_H
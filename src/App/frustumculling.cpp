@@ -0,0 +1,237 @@
+#include "frustumculling.h"
+
+#include <cassert>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLING_SSE
+#include <immintrin.h>
+// GCC and Clang compile the AVX kernel for its own target and pick it at
+// runtime; MSVC only uses it when the whole build targets AVX.
+#if defined(__GNUC__) || defined(__clang__)
+#define FRUSTUM_CULLING_AVX __attribute__((target("avx")))
+#elif defined(__AVX__)
+#define FRUSTUM_CULLING_AVX
+#endif
+#endif
+
+namespace
+{
+
+// Per plane, the components of the box corner furthest along the plane normal.
+struct PlaneCorners
+{
+	std::array<float, 4> plane;
+	std::array<const float *, 3> corner;
+};
+
+std::array<PlaneCorners, 6> planeCorners(const Frustum & frustum, const BoxList & boxes)
+{
+	std::array<PlaneCorners, 6> result;
+	for (size_t i = 0; i < result.size(); ++i)
+	{
+		const auto & plane = frustum.planes[i];
+		result[i].plane = plane;
+		result[i].corner = {
+			plane[0] > 0.0f ? boxes.maxX() : boxes.minX(),
+			plane[1] > 0.0f ? boxes.maxY() : boxes.minY(),
+			plane[2] > 0.0f ? boxes.maxZ() : boxes.minZ()};
+	}
+	return result;
+}
+
+[[maybe_unused]] void cullScalar(const std::array<PlaneCorners, 6> & planes, const size_t count,
+								 std::span<uint8_t> visible)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		bool inside = true;
+		for (const auto & [plane, corner]: planes)
+		{
+			inside = inside && plane[0] * corner[0][i] + plane[1] * corner[1][i] + plane[2] * corner[2][i] + plane[3] >= 0.0f;
+		}
+		visible[i] = inside ? 1 : 0;
+	}
+}
+
+#ifdef FRUSTUM_CULLING_SSE
+// The component arrays are padded to whole batches, so the last batch may read past count.
+void cullSse(const std::array<PlaneCorners, 6> & planes, const size_t count, std::span<uint8_t> visible)
+{
+	const auto zero = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += 4)
+	{
+		auto outside = _mm_setzero_ps();
+		for (const auto & [plane, corner]: planes)
+		{
+			auto distance = _mm_set1_ps(plane[3]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane[0]), _mm_loadu_ps(corner[0] + i)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane[1]), _mm_loadu_ps(corner[1] + i)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane[2]), _mm_loadu_ps(corner[2] + i)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+		}
+
+		const auto mask = _mm_movemask_ps(outside);
+		for (size_t lane = 0; lane < 4 && i + lane < count; ++lane)
+		{
+			visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+}
+#endif
+
+#ifdef FRUSTUM_CULLING_AVX
+FRUSTUM_CULLING_AVX void cullAvx(const std::array<PlaneCorners, 6> & planes, const size_t count,
+								 std::span<uint8_t> visible)
+{
+	const auto zero = _mm256_setzero_ps();
+	for (size_t i = 0; i < count; i += 8)
+	{
+		auto outside = _mm256_setzero_ps();
+		for (const auto & [plane, corner]: planes)
+		{
+			auto distance = _mm256_set1_ps(plane[3]);
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane[0]), _mm256_loadu_ps(corner[0] + i)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane[1]), _mm256_loadu_ps(corner[1] + i)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane[2]), _mm256_loadu_ps(corner[2] + i)));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, zero, _CMP_LT_OQ));
+		}
+
+		const auto mask = _mm256_movemask_ps(outside);
+		for (size_t lane = 0; lane < 8 && i + lane < count; ++lane)
+		{
+			visible[i + lane] = (mask >> lane) & 1 ? 0 : 1;
+		}
+	}
+}
+
+bool hasAvx()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	static const bool result = __builtin_cpu_supports("avx");
+	return result;
+#else
+	return true;
+#endif
+}
+#endif
+
+}// namespace
+
+Frustum Frustum::fromMatrix(const float * m)
+{
+	// Row r of the matrix is (m[r], m[4 + r], m[8 + r], m[12 + r]).
+	const auto row = [m](const int r) {
+		return std::array<float, 4>{m[r], m[4 + r], m[8 + r], m[12 + r]};
+	};
+	const auto combine = [](const std::array<float, 4> & a, const std::array<float, 4> & b, const float sign) {
+		return std::array<float, 4>{a[0] + sign * b[0], a[1] + sign * b[1], a[2] + sign * b[2], a[3] + sign * b[3]};
+	};
+
+	const auto w = row(3);
+	Frustum frustum;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		frustum.planes[2 * axis] = combine(w, row(axis), 1.0f);
+		frustum.planes[2 * axis + 1] = combine(w, row(axis), -1.0f);
+	}
+	return frustum;
+}
+
+void BoxList::clear()
+{
+	for (auto & component: components_)
+	{
+		component.clear();
+	}
+	size_ = 0;
+}
+
+void BoxList::reserve(const size_t count)
+{
+	for (auto & component: components_)
+	{
+		component.reserve((count + g_batch - 1) / g_batch * g_batch);
+	}
+}
+
+void BoxList::add(const Aabb & box)
+{
+	// Grow by a whole batch of empty boxes, their lanes are computed and dropped.
+	if (size_ % g_batch == 0)
+	{
+		for (auto & component: components_)
+		{
+			component.resize(size_ + g_batch, 0.0f);
+		}
+	}
+
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		components_[axis][size_] = box.min[axis];
+		components_[3 + axis][size_] = box.max[axis];
+	}
+	++size_;
+}
+
+size_t BoxList::size() const
+{
+	return size_;
+}
+
+Aabb BoxList::box(const size_t index) const
+{
+	assert(index < size_);
+	return {
+		{components_[0][index], components_[1][index], components_[2][index]},
+		{components_[3][index], components_[4][index], components_[5][index]}};
+}
+
+const float * BoxList::minX() const
+{
+	return components_[0].data();
+}
+
+const float * BoxList::minY() const
+{
+	return components_[1].data();
+}
+
+const float * BoxList::minZ() const
+{
+	return components_[2].data();
+}
+
+const float * BoxList::maxX() const
+{
+	return components_[3].data();
+}
+
+const float * BoxList::maxY() const
+{
+	return components_[4].data();
+}
+
+const float * BoxList::maxZ() const
+{
+	return components_[5].data();
+}
+
+void cullBoxes(const Frustum & frustum, const BoxList & boxes, std::span<uint8_t> visible)
+{
+	assert(visible.size() >= boxes.size());
+	const auto planes = planeCorners(frustum, boxes);
+	const auto count = boxes.size();
+
+#ifdef FRUSTUM_CULLING_AVX
+	if (hasAvx())
+	{
+		cullAvx(planes, count, visible);
+		return;
+	}
+#endif
+#ifdef FRUSTUM_CULLING_SSE
+	cullSse(planes, count, visible);
+#else
+	cullScalar(planes, count, visible);
+#endif
+}
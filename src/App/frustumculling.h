@@ -0,0 +1,69 @@
+#ifndef FRUSTUMCULLING_H
+#define FRUSTUMCULLING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Axis-aligned box, min > max on any axis means empty.
+struct Aabb
+{
+	std::array<float, 3> min;
+	std::array<float, 3> max;
+};
+
+// Six planes (a, b, c, d), a point p is inside if a*x + b*y + c*z + d >= 0 for all.
+struct Frustum
+{
+	std::array<std::array<float, 4>, 6> planes;
+
+	// Planes of the clip volume of a column-major projection * view * model
+	// matrix, in the space the matrix maps from (Gribb/Hartmann).
+	static Frustum fromMatrix(const float * columnMajor);
+};
+
+// Draws of a frame that went through culling, that survived it, and that
+// were inside the frustum but removed by occlusion culling.
+struct CullStats
+{
+	size_t tested = 0;
+	size_t visible = 0;
+	size_t occluded = 0;
+};
+
+// Boxes in structure-of-arrays layout, padded to whole SIMD batches, so the
+// culling loop loads the same component of 4 or 8 boxes with one instruction.
+class BoxList
+{
+public:
+	// Boxes processed per batch by the widest kernel.
+	static constexpr size_t g_batch = 8;
+
+	void clear();
+	void reserve(size_t count);
+	void add(const Aabb & box);
+
+	[[nodiscard]] size_t size() const;
+	[[nodiscard]] Aabb box(size_t index) const;
+
+	// Component arrays, each padded to a multiple of g_batch.
+	[[nodiscard]] const float * minX() const;
+	[[nodiscard]] const float * minY() const;
+	[[nodiscard]] const float * minZ() const;
+	[[nodiscard]] const float * maxX() const;
+	[[nodiscard]] const float * maxY() const;
+	[[nodiscard]] const float * maxZ() const;
+
+private:
+	std::array<std::vector<float>, 6> components_;// min xyz, max xyz
+	size_t size_ = 0;
+};
+
+// Sets visible[i] to 1 if box i intersects the frustum, 0 if it is entirely
+// outside one plane. Conservative: boxes near a corner may pass. Uses AVX
+// when the CPU has it, SSE on other x86 CPUs and scalar code elsewhere.
+void cullBoxes(const Frustum & frustum, const BoxList & boxes, std::span<uint8_t> visible);
+
+#endif // FRUSTUMCULLING_H
@@ -0,0 +1,283 @@
+#include "glcallcounter.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+
+size_t triangleCount(const GLenum mode, const GLsizei count)
+{
+	switch (mode)
+	{
+		case GL_TRIANGLES:
+			return static_cast<size_t>(count) / 3;
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			return static_cast<size_t>(std::max(0, count - 2));
+		default:
+			return 0;
+	}
+}
+
+}// namespace
+
+size_t GLCallStats::totalCalls() const
+{
+	return std::accumulate(calls.begin(), calls.end(), size_t{0});
+}
+
+void GLCallCounter::beginFrame()
+{
+	stats_ = {};
+	program_.reset();
+	vertexArray_.reset();
+	activeTexture_.reset();
+	buffers_.fill(std::nullopt);
+	textures_.fill(std::nullopt);
+	capabilities_.fill(std::nullopt);
+}
+
+const GLCallStats & GLCallCounter::stats() const
+{
+	return stats_;
+}
+
+template<typename T>
+bool GLCallCounter::track(std::optional<T> & slot, const T value)
+{
+	if (slot == value)
+	{
+		++stats_.redundantBinds;
+		return false;
+	}
+	slot = value;
+	++stats_.stateChanges;
+	return true;
+}
+
+template<typename T, size_t N>
+void GLCallCounter::track(std::array<std::optional<T>, N> & bindings, const size_t index, const T value)
+{
+	if (index < N)
+	{
+		track(bindings[index], value);
+	}
+	else
+	{
+		++stats_.stateChanges;
+	}
+}
+
+void GLCallCounter::glUseProgram(const GLuint program)
+{
+	++stats_.calls[GLCallStats::UseProgram];
+	track(program_, program);
+	QOpenGLFunctions_3_3_Core::glUseProgram(program);
+}
+
+void GLCallCounter::glBindVertexArray(const GLuint array)
+{
+	++stats_.calls[GLCallStats::BindVertexArray];
+	if (track(vertexArray_, array))
+	{
+		// The element array binding is part of the vertex array state.
+		buffers_[ElementArrayBuffer].reset();
+	}
+	QOpenGLFunctions_3_3_Core::glBindVertexArray(array);
+}
+
+void GLCallCounter::glBindBuffer(const GLenum target, const GLuint buffer)
+{
+	++stats_.calls[GLCallStats::BindBuffer];
+	track(buffers_, bufferTarget(target), buffer);
+	QOpenGLFunctions_3_3_Core::glBindBuffer(target, buffer);
+}
+
+void GLCallCounter::glActiveTexture(const GLenum texture)
+{
+	++stats_.calls[GLCallStats::ActiveTexture];
+	track(activeTexture_, texture);
+	QOpenGLFunctions_3_3_Core::glActiveTexture(texture);
+}
+
+void GLCallCounter::glBindTexture(const GLenum target, const GLuint texture)
+{
+	++stats_.calls[GLCallStats::BindTexture];
+	// Without a known unit the binding cannot be attributed, count it as a change.
+	const auto unit = activeTexture_ ? static_cast<size_t>(*activeTexture_ - GL_TEXTURE0) : g_textureUnits;
+	const auto slot = textureTarget(target);
+	track(textures_, unit < g_textureUnits && slot < TextureTargetCount ? unit * TextureTargetCount + slot : textures_.size(),
+		  texture);
+	QOpenGLFunctions_3_3_Core::glBindTexture(target, texture);
+}
+
+void GLCallCounter::glEnable(const GLenum cap)
+{
+	++stats_.calls[GLCallStats::Capability];
+	track(capabilities_, capability(cap), true);
+	QOpenGLFunctions_3_3_Core::glEnable(cap);
+}
+
+void GLCallCounter::glDisable(const GLenum cap)
+{
+	++stats_.calls[GLCallStats::Capability];
+	track(capabilities_, capability(cap), false);
+	QOpenGLFunctions_3_3_Core::glDisable(cap);
+}
+
+void GLCallCounter::glUniform1i(const GLint location, const GLint v0)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform1i(location, v0);
+}
+
+void GLCallCounter::glUniform1ui(const GLint location, const GLuint v0)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform1ui(location, v0);
+}
+
+void GLCallCounter::glUniform1f(const GLint location, const GLfloat v0)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform1f(location, v0);
+}
+
+void GLCallCounter::glUniform2fv(const GLint location, const GLsizei count, const GLfloat * value)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform2fv(location, count, value);
+}
+
+void GLCallCounter::glUniform3fv(const GLint location, const GLsizei count, const GLfloat * value)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform3fv(location, count, value);
+}
+
+void GLCallCounter::glUniform4fv(const GLint location, const GLsizei count, const GLfloat * value)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniform4fv(location, count, value);
+}
+
+void GLCallCounter::glUniformMatrix4fv(const GLint location, const GLsizei count, const GLboolean transpose,
+									   const GLfloat * value)
+{
+	++stats_.calls[GLCallStats::Uniform];
+	QOpenGLFunctions_3_3_Core::glUniformMatrix4fv(location, count, transpose, value);
+}
+
+void GLCallCounter::glBufferData(const GLenum target, const GLsizeiptr size, const void * data, const GLenum usage)
+{
+	++stats_.calls[GLCallStats::BufferUpload];
+	QOpenGLFunctions_3_3_Core::glBufferData(target, size, data, usage);
+}
+
+void GLCallCounter::glBufferSubData(const GLenum target, const GLintptr offset, const GLsizeiptr size, const void * data)
+{
+	++stats_.calls[GLCallStats::BufferUpload];
+	QOpenGLFunctions_3_3_Core::glBufferSubData(target, offset, size, data);
+}
+
+void GLCallCounter::glClear(const GLbitfield mask)
+{
+	++stats_.calls[GLCallStats::Clear];
+	QOpenGLFunctions_3_3_Core::glClear(mask);
+}
+
+void GLCallCounter::draw(const GLenum mode, const GLsizei count, const GLsizei instances)
+{
+	++stats_.calls[GLCallStats::Draw];
+	++stats_.drawCalls;
+	stats_.triangles += triangleCount(mode, count) * static_cast<size_t>(std::max(0, instances));
+}
+
+void GLCallCounter::countMultiDraw(const GLenum mode, std::span<const DrawElementsIndirectCommand> commands)
+{
+	++stats_.calls[GLCallStats::Draw];
+	++stats_.drawCalls;
+	for (const auto & command: commands)
+	{
+		stats_.triangles += triangleCount(mode, static_cast<GLsizei>(command.count)) * command.instanceCount;
+	}
+}
+
+void GLCallCounter::glDrawArrays(const GLenum mode, const GLint first, const GLsizei count)
+{
+	draw(mode, count, 1);
+	QOpenGLFunctions_3_3_Core::glDrawArrays(mode, first, count);
+}
+
+void GLCallCounter::glDrawElements(const GLenum mode, const GLsizei count, const GLenum type, const void * indices)
+{
+	draw(mode, count, 1);
+	QOpenGLFunctions_3_3_Core::glDrawElements(mode, count, type, indices);
+}
+
+void GLCallCounter::glDrawElementsInstanced(const GLenum mode, const GLsizei count, const GLenum type,
+											const void * indices, const GLsizei instancecount)
+{
+	draw(mode, count, instancecount);
+	QOpenGLFunctions_3_3_Core::glDrawElementsInstanced(mode, count, type, indices, instancecount);
+}
+
+size_t GLCallCounter::bufferTarget(const GLenum target)
+{
+	switch (target)
+	{
+		case GL_ARRAY_BUFFER:
+			return ArrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return ElementArrayBuffer;
+		case GL_UNIFORM_BUFFER:
+			return UniformBuffer;
+		case GL_TEXTURE_BUFFER:
+			return TextureBuffer;
+		case GL_DRAW_INDIRECT_BUFFER:
+			return DrawIndirectBuffer;
+		case GL_SHADER_STORAGE_BUFFER:
+			return ShaderStorageBuffer;
+		default:
+			return BufferTargetCount;
+	}
+}
+
+size_t GLCallCounter::textureTarget(const GLenum target)
+{
+	switch (target)
+	{
+		case GL_TEXTURE_2D:
+			return Texture2D;
+		case GL_TEXTURE_2D_MULTISAMPLE:
+			return Texture2DMultisample;
+		case GL_TEXTURE_CUBE_MAP:
+			return TextureCubeMap;
+		case GL_TEXTURE_BUFFER:
+			return TextureBufferTarget;
+		default:
+			return TextureTargetCount;
+	}
+}
+
+size_t GLCallCounter::capability(const GLenum capability)
+{
+	switch (capability)
+	{
+		case GL_DEPTH_TEST:
+			return DepthTest;
+		case GL_CULL_FACE:
+			return CullFace;
+		case GL_BLEND:
+			return Blend;
+		case GL_SCISSOR_TEST:
+			return ScissorTest;
+		case GL_STENCIL_TEST:
+			return StencilTest;
+		case GL_MULTISAMPLE:
+			return Multisample;
+		default:
+			return CapabilityCount;
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef GLCALLCOUNTER_H
+#define GLCALLCOUNTER_H
+
+#include "renderlist.h"
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+
+// Calls issued through a GLCallCounter since its last beginFrame().
+struct GLCallStats
+{
+	enum Call
+	{
+		UseProgram,
+		BindVertexArray,
+		BindBuffer,
+		ActiveTexture,
+		BindTexture,
+		Capability,// glEnable / glDisable
+		Uniform,
+		BufferUpload,
+		Clear,
+		Draw,
+		CallCount
+	};
+
+	std::array<size_t, CallCount> calls{};
+	size_t drawCalls = 0;
+	size_t triangles = 0;
+	// Binds and capability toggles that changed the tracked state.
+	size_t stateChanges = 0;
+	// Binds and toggles that set what was already current.
+	size_t redundantBinds = 0;
+
+	[[nodiscard]] size_t totalCalls() const;
+};
+
+// Function table that counts the state, uniform and draw calls made through
+// it and flags redundant binds. It shadows the instrumented functions of
+// QOpenGLFunctions_3_3_Core, so only calls made through this type are seen:
+// the renderer's GL helpers take a GLCallCounter for that reason, while Qt's
+// own calls and the 4.3 table of the compute passes bypass it.
+// Bindings are remembered from beginFrame() on, since GL state changed by
+// anything else between frames is invisible to it. Binds of targets, units
+// and capabilities outside the tracked set always count as state changes.
+class GLCallCounter : public QOpenGLFunctions_3_3_Core
+{
+public:
+	// Resets the counters and forgets the remembered bindings.
+	void beginFrame();
+	[[nodiscard]] const GLCallStats & stats() const;
+
+	void glUseProgram(GLuint program);
+	void glBindVertexArray(GLuint array);
+	void glBindBuffer(GLenum target, GLuint buffer);
+	void glActiveTexture(GLenum texture);
+	void glBindTexture(GLenum target, GLuint texture);
+	void glEnable(GLenum cap);
+	void glDisable(GLenum cap);
+
+	void glUniform1i(GLint location, GLint v0);
+	void glUniform1ui(GLint location, GLuint v0);
+	void glUniform1f(GLint location, GLfloat v0);
+	void glUniform2fv(GLint location, GLsizei count, const GLfloat * value);
+	void glUniform3fv(GLint location, GLsizei count, const GLfloat * value);
+	void glUniform4fv(GLint location, GLsizei count, const GLfloat * value);
+	void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat * value);
+
+	void glBufferData(GLenum target, GLsizeiptr size, const void * data, GLenum usage);
+	void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void * data);
+
+	void glClear(GLbitfield mask);
+	void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+	void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices);
+	void glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instancecount);
+	// glMultiDrawElementsIndirect is not part of this table: the caller issues
+	// it through the 4.3 functions and reports the commands it drew here.
+	void countMultiDraw(GLenum mode, std::span<const DrawElementsIndirectCommand> commands);
+
+private:
+	enum BufferTarget
+	{
+		ArrayBuffer,
+		ElementArrayBuffer,
+		UniformBuffer,
+		TextureBuffer,
+		DrawIndirectBuffer,
+		ShaderStorageBuffer,
+		BufferTargetCount
+	};
+
+	enum TextureTarget
+	{
+		Texture2D,
+		Texture2DMultisample,
+		TextureCubeMap,
+		TextureBufferTarget,
+		TextureTargetCount
+	};
+
+	enum Capability
+	{
+		DepthTest,
+		CullFace,
+		Blend,
+		ScissorTest,
+		StencilTest,
+		Multisample,
+		CapabilityCount
+	};
+
+	static constexpr size_t g_textureUnits = 16;
+
+	// Slot indices, the count of their enum if the value is not tracked.
+	static size_t bufferTarget(GLenum target);
+	static size_t textureTarget(GLenum target);
+	static size_t capability(GLenum capability);
+
+	// Counts a bind of value into slot, returns false if it was redundant.
+	template<typename T>
+	bool track(std::optional<T> & slot, T value);
+	// Like track() for bindings[index], a change if it is out of range.
+	template<typename T, size_t N>
+	void track(std::array<std::optional<T>, N> & bindings, size_t index, T value);
+	void draw(GLenum mode, GLsizei count, GLsizei instances);
+
+	GLCallStats stats_;
+
+	std::optional<GLuint> program_;
+	std::optional<GLuint> vertexArray_;
+	std::optional<GLenum> activeTexture_;
+	std::array<std::optional<GLuint>, BufferTargetCount> buffers_;
+	std::array<std::optional<GLuint>, g_textureUnits * TextureTargetCount> textures_;// by unit, then target
+	std::array<std::optional<bool>, CapabilityCount> capabilities_;
+};
+
+#endif // GLCALLCOUNTER_H
@@ -0,0 +1,148 @@
+#include "glstatecache.h"
+
+namespace
+{
+
+// Never returned by glGen*, marks a binding as unknown.
+constexpr GLuint g_unknown = ~GLuint{0};
+
+}// namespace
+
+GLStateCache::GLStateCache(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+	invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+	program_ = g_unknown;
+	vertexArray_ = g_unknown;
+	activeUnit_ = g_unknown;
+	buffers_.fill(g_unknown);
+	textures_.fill({GL_NONE, g_unknown});
+	capabilities_.fill(-1);
+}
+
+bool GLStateCache::useProgram(const GLuint program)
+{
+	if (program_ == program)
+	{
+		return false;
+	}
+	program_ = program;
+	funcs_.glUseProgram(program);
+	return true;
+}
+
+bool GLStateCache::bindVertexArray(const GLuint array)
+{
+	if (vertexArray_ == array)
+	{
+		return false;
+	}
+	vertexArray_ = array;
+	// The element array binding is part of the vertex array state.
+	buffers_[ElementArrayBuffer] = g_unknown;
+	funcs_.glBindVertexArray(array);
+	return true;
+}
+
+bool GLStateCache::bindBuffer(const GLenum target, const GLuint buffer)
+{
+	const auto index = bufferTarget(target);
+	if (index != UntrackedBuffer)
+	{
+		if (buffers_[index] == buffer)
+		{
+			return false;
+		}
+		buffers_[index] = buffer;
+	}
+	funcs_.glBindBuffer(target, buffer);
+	return true;
+}
+
+bool GLStateCache::activeTexture(const GLuint unit)
+{
+	if (activeUnit_ == unit)
+	{
+		return false;
+	}
+	activeUnit_ = unit;
+	funcs_.glActiveTexture(GL_TEXTURE0 + unit);
+	return true;
+}
+
+bool GLStateCache::bindTexture(const GLuint unit, const GLenum target, const GLuint texture)
+{
+	if (unit < g_textureUnits)
+	{
+		auto & binding = textures_[unit];
+		if (binding.target == target && binding.texture == texture)
+		{
+			return false;
+		}
+		binding = {target, texture};
+	}
+	activeTexture(unit);
+	funcs_.glBindTexture(target, texture);
+	return true;
+}
+
+bool GLStateCache::setEnabled(const GLenum capability, const bool enabled)
+{
+	const auto index = GLStateCache::capability(capability);
+	if (index != UntrackedCapability)
+	{
+		if (capabilities_[index] == static_cast<int>(enabled))
+		{
+			return false;
+		}
+		capabilities_[index] = static_cast<int>(enabled);
+	}
+
+	if (enabled)
+	{
+		funcs_.glEnable(capability);
+	}
+	else
+	{
+		funcs_.glDisable(capability);
+	}
+	return true;
+}
+
+auto GLStateCache::bufferTarget(const GLenum target) -> BufferTarget
+{
+	switch (target)
+	{
+		case GL_ARRAY_BUFFER:
+			return ArrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return ElementArrayBuffer;
+		case GL_UNIFORM_BUFFER:
+			return UniformBuffer;
+		case GL_DRAW_INDIRECT_BUFFER:
+			return DrawIndirectBuffer;
+		case GL_SHADER_STORAGE_BUFFER:
+			return ShaderStorageBuffer;
+		default:
+			return UntrackedBuffer;
+	}
+}
+
+auto GLStateCache::capability(const GLenum capability) -> Capability
+{
+	switch (capability)
+	{
+		case GL_DEPTH_TEST:
+			return DepthTest;
+		case GL_CULL_FACE:
+			return CullFace;
+		case GL_BLEND:
+			return Blend;
+		default:
+			return UntrackedCapability;
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include "glcallcounter.h"
+
+#include <array>
+#include <cstddef>
+
+// Shadow copy of the GL bindings the render passes change: program, vertex
+// array, buffers, textures per unit and capabilities. A call that would set
+// what is already current is skipped. State changed behind its back (by Qt,
+// the upload caches or another function table) is not seen, so the owner
+// calls invalidate() whenever that may have happened, at least once a frame.
+// Every setter returns true if it issued the GL call.
+class GLStateCache
+{
+public:
+	// Calls go through the counter, skipped calls never show up in its stats.
+	explicit GLStateCache(GLCallCounter & funcs);
+
+	GLStateCache(const GLStateCache &) = delete;
+	GLStateCache & operator=(const GLStateCache &) = delete;
+
+	// Forgets everything, the next call of every setter reaches GL.
+	void invalidate();
+
+	bool useProgram(GLuint program);
+	bool bindVertexArray(GLuint array);
+	// Targets outside the tracked set are always forwarded.
+	bool bindBuffer(GLenum target, GLuint buffer);
+	bool activeTexture(GLuint unit);
+	// Makes unit active if needed. Units beyond the tracked count are always forwarded.
+	bool bindTexture(GLuint unit, GLenum target, GLuint texture);
+	bool setEnabled(GLenum capability, bool enabled);
+
+private:
+	enum BufferTarget
+	{
+		ArrayBuffer,
+		ElementArrayBuffer,
+		UniformBuffer,
+		DrawIndirectBuffer,
+		ShaderStorageBuffer,
+		BufferTargetCount,
+		UntrackedBuffer = BufferTargetCount
+	};
+
+	enum Capability
+	{
+		DepthTest,
+		CullFace,
+		Blend,
+		CapabilityCount,
+		UntrackedCapability = CapabilityCount
+	};
+
+	// Last texture bound to a unit. Binding another target on the unit makes
+	// the next bind of the first one go through again, which is conservative.
+	struct TextureBinding
+	{
+		GLenum target;
+		GLuint texture;
+	};
+
+	static constexpr size_t g_textureUnits = 16;
+
+	static BufferTarget bufferTarget(GLenum target);
+	static Capability capability(GLenum capability);
+
+	GLCallCounter & funcs_;
+
+	GLuint program_;
+	GLuint vertexArray_;
+	GLuint activeUnit_;
+	std::array<GLuint, BufferTargetCount> buffers_;
+	std::array<TextureBinding, g_textureUnits> textures_;
+	std::array<int, CapabilityCount> capabilities_;// 0 disabled, 1 enabled, -1 unknown
+};
+
+#endif // GLSTATECACHE_H
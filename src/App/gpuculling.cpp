@@ -0,0 +1,334 @@
+#include "gpuculling.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace
+{
+
+// Threads per work group, local_size_x of cull.comp.
+constexpr GLuint g_groupSize = 64;
+
+// Unbounded boxes are clamped, infinities would turn the plane test into NaN.
+constexpr float g_boundsLimit = 1e18f;
+
+// Shader storage bindings of cull.comp.
+enum StorageBinding : GLuint
+{
+	BoundsBinding,
+	GroupsBinding,
+	CommandsBinding,
+	SlotsBinding,
+	EarlyCommandsBinding,
+	PendingBinding,
+	StorageBindingCount
+};
+
+// Texture unit of the depth pyramid.
+constexpr GLint g_hizUnit = 0;
+
+// Visible and occluded count at the start of each command buffer.
+constexpr GLsizeiptr g_countBytes = 2 * sizeof(GLuint);
+
+}// namespace
+
+GpuCulling::GpuCulling(QOpenGLFunctions_4_3_Core & funcs)
+	: funcs_{funcs}
+{
+}
+
+GpuCulling::~GpuCulling()
+{
+	assert(commandBuffer_ == 0 && "GpuCulling::release() must be called with a current context");
+}
+
+bool GpuCulling::create()
+{
+	program_ = std::make_unique<QOpenGLShaderProgram>();
+	if (!program_->addShaderFromSourceFile(QOpenGLShader::Compute, ":/Shaders/cull.comp") || !program_->link())
+	{
+		program_.reset();
+		return false;
+	}
+	passUniform_ = program_->uniformLocation("pass");
+	planesUniform_ = program_->uniformLocation("planes");
+	recordCountUniform_ = program_->uniformLocation("record_count");
+	hizViewProjectionUniform_ = program_->uniformLocation("hiz_view_projection");
+	hizViewportUniform_ = program_->uniformLocation("hiz_viewport");
+	hizLevelsUniform_ = program_->uniformLocation("hiz_levels");
+	program_->bind();
+	program_->setUniformValue("hiz", g_hizUnit);
+	program_->release();
+
+	for (GLuint * buffer: {&boundsBuffer_, &groupsBuffer_, &templateBuffer_, &commandBuffer_, &lateCommandBuffer_, &pendingBuffer_})
+	{
+		funcs_.glGenBuffers(1, buffer);
+	}
+	for (auto & readback: readbacks_)
+	{
+		funcs_.glGenBuffers(1, &readback.buffer);
+		funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+		funcs_.glBufferData(GL_COPY_WRITE_BUFFER, 2 * g_countBytes, nullptr, GL_STREAM_READ);
+	}
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
+
+void GpuCulling::release()
+{
+	program_.reset();
+	for (auto & readback: readbacks_)
+	{
+		if (readback.fence != nullptr)
+		{
+			funcs_.glDeleteSync(readback.fence);
+		}
+		if (readback.buffer != 0)
+		{
+			funcs_.glDeleteBuffers(1, &readback.buffer);
+		}
+		readback = {};
+	}
+	for (GLuint * buffer: {&boundsBuffer_, &groupsBuffer_, &templateBuffer_, &commandBuffer_, &lateCommandBuffer_, &pendingBuffer_})
+	{
+		if (*buffer != 0)
+		{
+			funcs_.glDeleteBuffers(1, buffer);
+			*buffer = 0;
+		}
+	}
+	buckets_.clear();
+	recordCount_ = 0;
+	stats_.reset();
+}
+
+void GpuCulling::build(std::span<const DrawRecord> records)
+{
+	TRACE_SCOPE("GpuCulling::build");
+	recordCount_ = records.size();
+	buckets_.clear();
+
+	// The first command holds the counts, zeroed by the template as well.
+	std::vector<DrawElementsIndirectCommand> commands(1, DrawElementsIndirectCommand{});
+	std::vector<GLuint> groups(records.size());
+	for (size_t i = 0; i < records.size();)
+	{
+		const DrawRecord & record = records[i];
+		auto end = i + 1;
+		while (end < records.size() && sameGeometry(records[end], record))
+		{
+			++end;
+		}
+
+		if (buckets_.empty() || !sameState(records[buckets_.back().record], record))
+		{
+			buckets_.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(commands.size() - 1), 0});
+		}
+		std::fill(groups.begin() + static_cast<std::ptrdiff_t>(i), groups.begin() + static_cast<std::ptrdiff_t>(end),
+				  static_cast<GLuint>(commands.size() - 1));
+		// Offsets inside the arenas are aligned to the index size, see g_bufferViewAlignment.
+		commands.push_back({
+			static_cast<GLuint>(record.indexCount),
+			0,
+			static_cast<GLuint>(record.indexOffset / indexSize(record.indexType)),
+			0,
+			static_cast<GLuint>(i),
+		});
+		++buckets_.back().commandCount;
+		i = end;
+	}
+
+	commandBytes_ = static_cast<GLsizeiptr>(commands.size() * sizeof(DrawElementsIndirectCommand));
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, templateBuffer_);
+	funcs_.glBufferData(GL_COPY_WRITE_BUFFER, commandBytes_, commands.data(), GL_STATIC_DRAW);
+	for (const GLuint buffer: {commandBuffer_, lateCommandBuffer_})
+	{
+		funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		funcs_.glBufferData(GL_COPY_WRITE_BUFFER, commandBytes_, nullptr, GL_DYNAMIC_COPY);
+	}
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, groupsBuffer_);
+	funcs_.glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(groups.size() * sizeof(GLuint)), groups.data(),
+						GL_STATIC_DRAW);
+	const std::vector<GLuint> pending(records.size(), 0);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, pendingBuffer_);
+	funcs_.glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(pending.size() * sizeof(GLuint)), pending.data(),
+						GL_DYNAMIC_COPY);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuCulling::updateBounds(const BoxList & bounds)
+{
+	TRACE_SCOPE("GpuCulling::updateBounds");
+	assert(bounds.size() == recordCount_);
+	// vec4 min and max corner of every box, the layout of Box in cull.comp.
+	std::vector<std::array<float, 8>> boxes(bounds.size());
+	for (size_t i = 0; i < bounds.size(); ++i)
+	{
+		const auto box = bounds.box(i);
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			boxes[i][axis] = std::clamp(box.min[axis], -g_boundsLimit, g_boundsLimit);
+			boxes[i][4 + axis] = std::clamp(box.max[axis], -g_boundsLimit, g_boundsLimit);
+		}
+	}
+
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, boundsBuffer_);
+	funcs_.glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(boxes.size() * sizeof(boxes[0])), boxes.data(),
+						GL_DYNAMIC_DRAW);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuCulling::cull(const Frustum & frustum, const GLuint slotBuffer, const DepthPyramid * occluders)
+{
+	TRACE_SCOPE("GpuCulling::cull");
+	collect();
+	if (recordCount_ == 0)
+	{
+		return;
+	}
+
+	funcs_.glBindBuffer(GL_COPY_READ_BUFFER, templateBuffer_);
+	for (const GLuint buffer: {commandBuffer_, lateCommandBuffer_})
+	{
+		funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		funcs_.glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes_);
+	}
+	funcs_.glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	program_->bind();
+	funcs_.glUniform4fv(planesUniform_, static_cast<GLsizei>(frustum.planes.size()), frustum.planes[0].data());
+	funcs_.glUniform1ui(recordCountUniform_, static_cast<GLuint>(recordCount_));
+	if (occluders != nullptr && !occluders->isValid())
+	{
+		// No earlier frame to test against, nothing is left for the late pass.
+		const GLuint zero = 0;
+		funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, pendingBuffer_);
+		funcs_.glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		occluders = nullptr;
+	}
+	dispatch(occluders != nullptr ? EarlyPass : FrustumPass, commandBuffer_, slotBuffer, occluders);
+	program_->release();
+}
+
+void GpuCulling::cullLate(const GLuint slotBuffer, const DepthPyramid & occluders)
+{
+	TRACE_SCOPE("GpuCulling::cullLate");
+	if (recordCount_ == 0)
+	{
+		return;
+	}
+
+	program_->bind();
+	dispatch(LatePass, lateCommandBuffer_, slotBuffer, &occluders);
+	program_->release();
+}
+
+void GpuCulling::dispatch(const Pass pass, const GLuint commands, const GLuint slotBuffer, const DepthPyramid * occluders)
+{
+	funcs_.glUniform1i(passUniform_, pass);
+	if (occluders != nullptr)
+	{
+		const auto viewport = occluders->viewport();
+		funcs_.glUniformMatrix4fv(hizViewProjectionUniform_, 1, GL_FALSE, occluders->viewProjection().data());
+		funcs_.glUniform2i(hizViewportUniform_, viewport[0], viewport[1]);
+		funcs_.glUniform1i(hizLevelsUniform_, occluders->levels());
+		funcs_.glActiveTexture(GL_TEXTURE0 + g_hizUnit);
+		funcs_.glBindTexture(GL_TEXTURE_2D, occluders->texture());
+	}
+
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BoundsBinding, boundsBuffer_);
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GroupsBinding, groupsBuffer_);
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CommandsBinding, commands);
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SlotsBinding, slotBuffer);
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EarlyCommandsBinding, commandBuffer_);
+	funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PendingBinding, pendingBuffer_);
+	funcs_.glDispatchCompute((static_cast<GLuint>(recordCount_) + g_groupSize - 1) / g_groupSize, 1, 1);
+	funcs_.glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT
+						   | GL_SHADER_STORAGE_BARRIER_BIT);
+	for (GLuint binding = 0; binding < StorageBindingCount; ++binding)
+	{
+		funcs_.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+	if (occluders != nullptr)
+	{
+		funcs_.glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// The frame is complete after the late pass, or after the early one without occlusion culling.
+	if (pass != EarlyPass)
+	{
+		readBack();
+	}
+}
+
+void GpuCulling::readBack()
+{
+	// Keep a copy of the counts unless all copies are still in flight.
+	auto & readback = readbacks_[nextReadback_];
+	if (readback.fence != nullptr)
+	{
+		return;
+	}
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+	for (const GLuint buffer: {commandBuffer_, lateCommandBuffer_})
+	{
+		funcs_.glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		funcs_.glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, buffer == commandBuffer_ ? 0 : g_countBytes,
+								   g_countBytes);
+	}
+	funcs_.glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	funcs_.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	readback.fence = funcs_.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextReadback_ = (nextReadback_ + 1) % readbacks_.size();
+}
+
+void GpuCulling::collect()
+{
+	// Oldest first, so the newest finished result wins.
+	for (size_t i = 0; i < readbacks_.size(); ++i)
+	{
+		auto & readback = readbacks_[(nextReadback_ + i) % readbacks_.size()];
+		if (readback.fence == nullptr)
+		{
+			continue;
+		}
+		const auto status = funcs_.glClientWaitSync(readback.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			continue;
+		}
+		funcs_.glDeleteSync(readback.fence);
+		readback.fence = nullptr;
+
+		// Visible and occluded count of the early, then of the late pass.
+		std::array<GLuint, 4> counts{};
+		funcs_.glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+		funcs_.glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts.data());
+		funcs_.glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		stats_ = CullStats{recordCount_, counts[0] + size_t{counts[2]}, counts[3]};
+	}
+}
+
+std::span<const IndirectDraws::Bucket> GpuCulling::buckets() const
+{
+	return buckets_;
+}
+
+GLuint GpuCulling::commandBuffer() const
+{
+	return commandBuffer_;
+}
+
+GLuint GpuCulling::lateCommandBuffer() const
+{
+	return lateCommandBuffer_;
+}
+
+std::optional<CullStats> GpuCulling::stats() const
+{
+	return stats_;
+}
@@ -0,0 +1,124 @@
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include "depthpyramid.h"
+#include "frustumculling.h"
+#include "indirectdraws.h"
+#include "renderlist.h"
+
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Frustum culling of the render list on the GPU, for GL 4.3+. A compute pass
+// tests the world box of every record from a shader storage buffer and
+// appends the visible ones to the instance slots of their geometry group, the
+// run of records of the same geometry in the sorted list. One command per
+// group, with the group's first record as base instance, thus draws exactly
+// the visible instances, and the CPU never touches per-record visibility.
+// The slots are InstanceBuffer::indexBuffer(), which the pass overwrites.
+//
+// With occlusion culling the frame takes two passes. The early pass also
+// tests the boxes against the DepthPyramid of the previous frame, as seen
+// from that frame's camera, and sets the occluded ones aside. Once the early
+// draws are in the depth buffer, the late pass re-tests only those against a
+// pyramid of this frame and draws whatever turned out visible, so objects
+// revealed by camera motion appear without a frame of delay.
+class GpuCulling
+{
+public:
+	explicit GpuCulling(QOpenGLFunctions_4_3_Core & funcs);
+	~GpuCulling();
+
+	GpuCulling(const GpuCulling &) = delete;
+	GpuCulling & operator=(const GpuCulling &) = delete;
+
+	// Compiles the compute shader and creates the buffers. Requires a current
+	// context, returns false if the shader does not compile.
+	bool create();
+	// Deletes all GL objects. Requires a current context.
+	void release();
+
+	// Groups the records into commands and state buckets, call after the
+	// render list was compiled. Bounds must be uploaded again afterwards.
+	void build(std::span<const DrawRecord> records);
+	// Uploads the world box of every record, in render list order.
+	void updateBounds(const BoxList & bounds);
+
+	// Early pass: resets the instance counts and culls the records against
+	// frustum, and against occluders if given and valid, writing the visible
+	// ones into slotBuffer. cullLate() must follow if occluders is given.
+	// Binds through funcs, past any state cache, and orders the results
+	// before later indirect draws and vertex fetches.
+	void cull(const Frustum & frustum, GLuint slotBuffer, const DepthPyramid * occluders);
+	// Late pass: re-tests the records the early pass found occluded against
+	// occluders, now built from the early draws, and appends the visible ones
+	// to slotBuffer after the early instances. Draws lateCommandBuffer().
+	void cullLate(GLuint slotBuffer, const DepthPyramid & occluders);
+
+	// State buckets over the commands of commandBuffer() and
+	// lateCommandBuffer(), which start at g_commandOffset. Their instance
+	// counts are only known to the GPU.
+	[[nodiscard]] std::span<const IndirectDraws::Bucket> buckets() const;
+	[[nodiscard]] GLuint commandBuffer() const;
+	[[nodiscard]] GLuint lateCommandBuffer() const;
+	static constexpr GLintptr g_commandOffset = sizeof(DrawElementsIndirectCommand);
+
+	// Result of a recent frame the GPU already finished, read back without
+	// waiting, so it lags a few frames. Empty before the first.
+	[[nodiscard]] std::optional<CullStats> stats() const;
+
+private:
+	// Passes of cull.comp.
+	enum Pass : GLint
+	{
+		FrustumPass,
+		EarlyPass,
+		LatePass
+	};
+
+	// Runs pass of cull.comp over all records into commands.
+	void dispatch(Pass pass, GLuint commands, GLuint slotBuffer, const DepthPyramid * occluders);
+	// Copies the counts of both passes for collect().
+	void readBack();
+
+	// A copy of the counts of both passes and the fence of the frame that wrote them.
+	struct Readback
+	{
+		GLuint buffer;
+		GLsync fence;
+	};
+
+	// Collects finished readbacks into visibleCount_.
+	void collect();
+
+	QOpenGLFunctions_4_3_Core & funcs_;
+	std::unique_ptr<QOpenGLShaderProgram> program_;
+	GLint passUniform_ = -1;
+	GLint planesUniform_ = -1;
+	GLint recordCountUniform_ = -1;
+	GLint hizViewProjectionUniform_ = -1;
+	GLint hizViewportUniform_ = -1;
+	GLint hizLevelsUniform_ = -1;
+
+	GLuint boundsBuffer_ = 0;
+	GLuint groupsBuffer_ = 0;
+	GLuint templateBuffer_ = 0;// commands with zero instances, copied over commandBuffer_ per cull
+	GLuint commandBuffer_ = 0;
+	GLuint lateCommandBuffer_ = 0;
+	GLuint pendingBuffer_ = 0;// per record, 1 if the early pass found it occluded
+	std::array<Readback, 3> readbacks_{};
+	size_t nextReadback_ = 0;
+
+	std::vector<IndirectDraws::Bucket> buckets_;
+	size_t recordCount_ = 0;
+	GLsizeiptr commandBytes_ = 0;
+	std::optional<CullStats> stats_;
+};
+
+#endif // GPUCULLING_H
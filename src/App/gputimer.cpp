@@ -0,0 +1,138 @@
+#include "gputimer.h"
+
+#include <cassert>
+
+namespace
+{
+
+// Scopes per frame the vectors are sized for, more only grow them once.
+constexpr size_t g_reservedScopes = 16;
+
+}// namespace
+
+GpuTimer::Scope::Scope(GpuTimer & timer, const size_t index)
+	: timer_{timer}
+	, index_{index}
+{
+	cpuTimer_.start();
+}
+
+GpuTimer::Scope::~Scope()
+{
+	timer_.end(index_, cpuTimer_.nsecsElapsed());
+}
+
+GpuTimer::GpuTimer(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+	for (auto & frame: frames_)
+	{
+		frame.scopes.reserve(g_reservedScopes);
+	}
+	results_.reserve(g_reservedScopes);
+}
+
+GpuTimer::~GpuTimer()
+{
+	assert(frames_[0].queries.empty() && frames_[1].queries.empty()
+		   && "GpuTimer::release() must be called with a current context");
+}
+
+void GpuTimer::beginFrame()
+{
+	current_ = (current_ + 1) % frames_.size();
+	Frame & frame = frames_[current_];
+	if (frame.submitted)
+	{
+		collect(frame);
+	}
+
+	frame.scopes.clear();
+	frame.index = ++frameIndex_;
+	frame.submitted = false;
+}
+
+void GpuTimer::endFrame()
+{
+	Frame & frame = frames_[current_];
+	frame.submitted = !frame.scopes.empty();
+}
+
+auto GpuTimer::scope(const char * name) -> Scope
+{
+	Frame & frame = frames_[current_];
+	const auto firstQuery = frame.scopes.size() * 2;
+	if (frame.queries.size() < firstQuery + 2)
+	{
+		frame.queries.resize(firstQuery + 2, 0);
+		funcs_.glGenQueries(2, &frame.queries[firstQuery]);
+	}
+
+	funcs_.glQueryCounter(frame.queries[firstQuery], GL_TIMESTAMP);
+	frame.scopes.push_back({name, firstQuery, 0});
+	return Scope{*this, frame.scopes.size() - 1};
+}
+
+void GpuTimer::end(const size_t index, const int64_t cpuNs)
+{
+	PendingScope & scope = frames_[current_].scopes[index];
+	funcs_.glQueryCounter(frames_[current_].queries[scope.firstQuery + 1], GL_TIMESTAMP);
+	scope.cpuNs = cpuNs;
+}
+
+void GpuTimer::collect(Frame & frame)
+{
+	// Checking the availability first keeps the readback below from blocking.
+	for (const auto & scope: frame.scopes)
+	{
+		GLint available = GL_FALSE;
+		funcs_.glGetQueryObjectiv(frame.queries[scope.firstQuery + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE)
+		{
+			++droppedFrames_;
+			return;
+		}
+	}
+
+	results_.clear();
+	for (const auto & scope: frame.scopes)
+	{
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		funcs_.glGetQueryObjectui64v(frame.queries[scope.firstQuery], GL_QUERY_RESULT, &begin);
+		funcs_.glGetQueryObjectui64v(frame.queries[scope.firstQuery + 1], GL_QUERY_RESULT, &end);
+		results_.push_back({scope.name, static_cast<double>(scope.cpuNs) / 1e6,
+							static_cast<double>(end - begin) / 1e6});
+	}
+	resultFrame_ = frame.index;
+}
+
+const std::vector<GpuTimer::ScopeTiming> & GpuTimer::results() const
+{
+	return results_;
+}
+
+uint64_t GpuTimer::resultFrame() const
+{
+	return resultFrame_;
+}
+
+uint64_t GpuTimer::droppedFrames() const
+{
+	return droppedFrames_;
+}
+
+void GpuTimer::release()
+{
+	for (auto & frame: frames_)
+	{
+		if (!frame.queries.empty())
+		{
+			funcs_.glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+		}
+		frame.queries.clear();
+		frame.scopes.clear();
+		frame.index = 0;
+		frame.submitted = false;
+	}
+}
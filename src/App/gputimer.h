@@ -0,0 +1,96 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include "glcallcounter.h"
+
+#include <QElapsedTimer>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// CPU and GPU duration of named scopes of a frame. The GPU side brackets each
+// scope with GL_TIMESTAMP queries, so scopes may nest. Query pools are
+// double-buffered: results of a frame are read back when its pool comes up
+// again two frames later, and only if the GPU already finished it, so timing
+// never stalls the pipeline. Frames whose queries are still pending are dropped.
+class GpuTimer
+{
+public:
+	struct ScopeTiming
+	{
+		const char * name;
+		double cpuMs;
+		double gpuMs;
+	};
+
+	// Ends its scope when destroyed.
+	class Scope
+	{
+	public:
+		Scope(GpuTimer & timer, size_t index);
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope & operator=(const Scope &) = delete;
+
+	private:
+		GpuTimer & timer_;
+		size_t index_;
+		QElapsedTimer cpuTimer_;
+	};
+
+	explicit GpuTimer(GLCallCounter & funcs);
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer &) = delete;
+	GpuTimer & operator=(const GpuTimer &) = delete;
+
+	// Switches to the next query pool, collecting the frame that used it last.
+	void beginFrame();
+	void endFrame();
+
+	// Times everything issued until the returned scope is destroyed. name is
+	// kept as is and must outlive the results, callers pass string literals.
+	[[nodiscard]] Scope scope(const char * name);
+
+	// Scopes of the latest collected frame, in the order they were opened.
+	[[nodiscard]] const std::vector<ScopeTiming> & results() const;
+	// Index of the frame results() belongs to, counted by beginFrame(); 0 if none yet.
+	[[nodiscard]] uint64_t resultFrame() const;
+	// Frames whose queries were not ready when their pool was reused.
+	[[nodiscard]] uint64_t droppedFrames() const;
+
+	// Deletes all queries. Requires a current context.
+	void release();
+
+private:
+	struct PendingScope
+	{
+		const char * name;
+		size_t firstQuery;// begin timestamp, the end timestamp follows it
+		int64_t cpuNs;
+	};
+
+	struct Frame
+	{
+		std::vector<GLuint> queries;
+		std::vector<PendingScope> scopes;
+		uint64_t index = 0;
+		bool submitted = false;
+	};
+
+	void end(size_t index, int64_t cpuNs);
+	void collect(Frame & frame);
+
+	GLCallCounter & funcs_;
+	std::array<Frame, 2> frames_;
+	size_t current_ = 0;
+	uint64_t frameIndex_ = 0;
+
+	std::vector<ScopeTiming> results_;
+	uint64_t resultFrame_ = 0;
+	uint64_t droppedFrames_ = 0;
+};
+
+#endif // GPUTIMER_H
@@ -0,0 +1,102 @@
+#include "indirectdraws.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+
+IndirectDraws::IndirectDraws(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+}
+
+IndirectDraws::~IndirectDraws()
+{
+	assert(buffer_ == 0 && "IndirectDraws::release() must be called with a current context");
+}
+
+void IndirectDraws::create()
+{
+	funcs_.glGenBuffers(1, &buffer_);
+	funcs_.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer_);
+	funcs_.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDraws::release()
+{
+	if (buffer_ != 0)
+	{
+		funcs_.glDeleteBuffers(1, &buffer_);
+		buffer_ = 0;
+	}
+	invalidate();
+}
+
+void IndirectDraws::update(std::span<const DrawRecord> records, std::span<const uint8_t> visible)
+{
+	if (valid_ && std::ranges::equal(visible, visible_))
+	{
+		return;
+	}
+	TRACE_SCOPE("IndirectDraws::update");
+	valid_ = true;
+	visible_.assign(visible.begin(), visible.end());
+
+	buckets_.clear();
+	commands_.clear();
+	for (size_t i = 0; i < records.size();)
+	{
+		if (!visible[i])
+		{
+			++i;
+			continue;
+		}
+
+		const DrawRecord & record = records[i];
+		auto end = i + 1;
+		while (end < records.size() && visible[end] && sameGeometry(records[end], record))
+		{
+			++end;
+		}
+
+		// Culled records in between do not split a bucket, only a state change does.
+		if (buckets_.empty() || !sameState(records[buckets_.back().record], record))
+		{
+			buckets_.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(commands_.size()), 0});
+		}
+		// Offsets inside the arenas are aligned to the index size, see g_bufferViewAlignment.
+		commands_.push_back({
+			static_cast<GLuint>(record.indexCount),
+			static_cast<GLuint>(end - i),
+			static_cast<GLuint>(record.indexOffset / indexSize(record.indexType)),
+			0,
+			static_cast<GLuint>(i),
+		});
+		++buckets_.back().commandCount;
+		i = end;
+	}
+
+	funcs_.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer_);
+	funcs_.glBufferData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLsizeiptr>(commands_.size() * sizeof(DrawElementsIndirectCommand)),
+						commands_.data(), GL_DYNAMIC_DRAW);
+	funcs_.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDraws::invalidate()
+{
+	valid_ = false;
+}
+
+std::span<const IndirectDraws::Bucket> IndirectDraws::buckets() const
+{
+	return buckets_;
+}
+
+std::span<const DrawElementsIndirectCommand> IndirectDraws::commands() const
+{
+	return commands_;
+}
+
+GLuint IndirectDraws::buffer() const
+{
+	return buffer_;
+}
@@ -0,0 +1,60 @@
+#ifndef INDIRECTDRAWS_H
+#define INDIRECTDRAWS_H
+
+#include "glcallcounter.h"
+#include "renderlist.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Draw commands of the visible render list records in a GL_DRAW_INDIRECT_BUFFER,
+// for glMultiDrawElementsIndirect on GL 4.3+. Every command draws one run of
+// records of the same geometry as instances starting at the first record, so
+// the vertex shader finds its world matrix at the base instance. Commands of
+// records sharing all state (see sameState()) form a bucket drawn by one call.
+class IndirectDraws
+{
+public:
+	// Commands [firstCommand, firstCommand + commandCount) drawn with the state of records[record].
+	struct Bucket
+	{
+		uint32_t record;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	explicit IndirectDraws(GLCallCounter & funcs);
+	~IndirectDraws();
+
+	IndirectDraws(const IndirectDraws &) = delete;
+	IndirectDraws & operator=(const IndirectDraws &) = delete;
+
+	// Creates the command buffer. Requires a current context.
+	void create();
+	// Deletes it. Requires a current context.
+	void release();
+
+	// Rebuilds and uploads the commands if the visible flags changed since the
+	// last call, so a still camera costs no upload. Binds the command buffer
+	// through funcs and leaves GL_DRAW_INDIRECT_BUFFER unbound.
+	void update(std::span<const DrawRecord> records, std::span<const uint8_t> visible);
+	// Makes the next update() rebuild, call after the render list was recompiled.
+	void invalidate();
+
+	[[nodiscard]] std::span<const Bucket> buckets() const;
+	[[nodiscard]] std::span<const DrawElementsIndirectCommand> commands() const;
+	// Command buffer to bind to GL_DRAW_INDIRECT_BUFFER for the draws.
+	[[nodiscard]] GLuint buffer() const;
+
+private:
+	GLCallCounter & funcs_;
+	GLuint buffer_ = 0;
+	std::vector<Bucket> buckets_;
+	std::vector<DrawElementsIndirectCommand> commands_;
+	// Visible flags of the last update, to skip unchanged frames.
+	std::vector<uint8_t> visible_;
+	bool valid_ = false;
+};
+
+#endif // INDIRECTDRAWS_H
@@ -0,0 +1,100 @@
+#include "instancebuffer.h"
+#include "trace.h"
+
+#include <cassert>
+#include <cstdint>
+#include <numeric>
+
+InstanceBuffer::InstanceBuffer(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	assert(buffer_ == 0 && texture_ == 0 && indexBuffer_ == 0 && "InstanceBuffer::release() must be called with a current context");
+}
+
+void InstanceBuffer::create()
+{
+	funcs_.glGenBuffers(1, &buffer_);
+	funcs_.glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+	funcs_.glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	funcs_.glGenTextures(1, &texture_);
+	funcs_.glBindTexture(GL_TEXTURE_BUFFER, texture_);
+	funcs_.glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer_);
+	funcs_.glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// Vertex arrays reference the buffer from the start, its contents follow with the records.
+	funcs_.glGenBuffers(1, &indexBuffer_);
+	funcs_.glBindBuffer(GL_ARRAY_BUFFER, indexBuffer_);
+	funcs_.glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::release()
+{
+	if (texture_ != 0)
+	{
+		funcs_.glDeleteTextures(1, &texture_);
+		texture_ = 0;
+	}
+	if (buffer_ != 0)
+	{
+		funcs_.glDeleteBuffers(1, &buffer_);
+		buffer_ = 0;
+	}
+	if (indexBuffer_ != 0)
+	{
+		funcs_.glDeleteBuffers(1, &indexBuffer_);
+		indexBuffer_ = 0;
+	}
+	indexCount_ = 0;
+}
+
+void InstanceBuffer::update(std::span<const DrawRecord> records, std::span<const TransformHierarchy::Matrix> worlds)
+{
+	TRACE_SCOPE("InstanceBuffer::update");
+	staging_.resize(records.size());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		staging_[i] = worlds[records[i].matrix];
+	}
+
+	// Respecifying the whole store lets the driver orphan the copy still in use.
+	funcs_.glBindBuffer(GL_TEXTURE_BUFFER, buffer_);
+	funcs_.glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(staging_.size() * sizeof(TransformHierarchy::Matrix)),
+						staging_.data(), GL_DYNAMIC_DRAW);
+	funcs_.glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	if (records.size() > indexCount_)
+	{
+		indexCount_ = records.size();
+		uploadIndices();
+	}
+}
+
+void InstanceBuffer::resetIndices()
+{
+	uploadIndices();
+}
+
+void InstanceBuffer::uploadIndices()
+{
+	std::vector<uint32_t> indices(indexCount_);
+	std::iota(indices.begin(), indices.end(), 0u);
+	funcs_.glBindBuffer(GL_ARRAY_BUFFER, indexBuffer_);
+	funcs_.glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(uint32_t)), indices.data(),
+						GL_DYNAMIC_DRAW);
+	funcs_.glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GLuint InstanceBuffer::texture() const
+{
+	return texture_;
+}
+
+GLuint InstanceBuffer::indexBuffer() const
+{
+	return indexBuffer_;
+}
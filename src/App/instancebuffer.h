@@ -0,0 +1,54 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include "glcallcounter.h"
+#include "renderlist.h"
+#include "transformhierarchy.h"
+
+#include <span>
+#include <vector>
+
+// World matrices of the render list records in a buffer texture, in record
+// order, one RGBA32F texel per column. A run of records that differ only in
+// their node is drawn with one instanced call, the vertex shader fetches
+// matrix instance_base + instance_index. The instance index is a per-instance
+// attribute rather than gl_InstanceID, so that a GL 4.3 indirect draw can pass
+// the first record as its base instance; GL 3.3 draws leave it at 0.
+class InstanceBuffer
+{
+public:
+	explicit InstanceBuffer(GLCallCounter & funcs);
+	~InstanceBuffer();
+
+	InstanceBuffer(const InstanceBuffer &) = delete;
+	InstanceBuffer & operator=(const InstanceBuffer &) = delete;
+
+	// Creates the buffer and its texture. Requires a current context.
+	void create();
+	// Deletes both. Requires a current context.
+	void release();
+
+	// Uploads the world matrix of every record, call after the node transforms changed.
+	void update(std::span<const DrawRecord> records, std::span<const TransformHierarchy::Matrix> worlds);
+
+	// GL_TEXTURE_BUFFER texture to bind for the draws.
+	[[nodiscard]] GLuint texture() const;
+	// Record of every instance slot as GL_UNSIGNED_INT, the source of the
+	// instance_index attribute with divisor 1. update() fills it with 0, 1,
+	// 2, ... to cover every record; GpuCulling compacts the visible records
+	// into it instead, after which resetIndices() brings back the identity.
+	[[nodiscard]] GLuint indexBuffer() const;
+	void resetIndices();
+
+private:
+	void uploadIndices();
+
+	GLCallCounter & funcs_;
+	GLuint buffer_ = 0;
+	GLuint texture_ = 0;
+	GLuint indexBuffer_ = 0;
+	size_t indexCount_ = 0;
+	std::vector<TransformHierarchy::Matrix> staging_;
+};
+
+#endif // INSTANCEBUFFER_H
@@ -1,7 +1,13 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QSurfaceFormat>
 
+#include "benchmark.h"
 #include "mainwindow.h"
+#include "trace.h"
+#include "Window.h"
+
+#include <iostream>
 
 namespace
 {
@@ -16,6 +22,44 @@ int main(int argc, char ** argv)
 	QApplication::setAttribute(Qt::AA_UseDesktopOpenGL);
 	QApplication app(argc, argv);
 
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	const QCommandLineOption maxFpsOption("max-fps", "Caps the frame rate, 0 means no cap.", "fps", "0");
+	const QCommandLineOption continuousOption("continuous", "Redraws every frame instead of on changes only.");
+	const QCommandLineOption modelOption("model", "glTF file to show.", "path");
+	const QCommandLineOption benchmarkOption("benchmark", "Renders offscreen along a scripted camera path and exits.");
+	const QCommandLineOption framesOption("frames", "Number of benchmark frames.", "count", "300");
+	const QCommandLineOption sizeOption("size", "Benchmark framebuffer size.", "WxH", "800x800");
+	const QCommandLineOption outputOption("output", "Benchmark results, .json or .csv.", "path", "benchmark.csv");
+	const QCommandLineOption traceOption("trace", "Writes a Chrome trace of the run (needs APP_ENABLE_TRACING).", "path");
+	const QCommandLineOption noIndirectOption("no-indirect", "Draws per instance run even where GL 4.3 multi-draw indirect is available.");
+	const QCommandLineOption cpuCullingOption("cpu-culling", "Culls on the CPU even where GL 4.3 compute culling is available.");
+	const QCommandLineOption noOcclusionOption("no-occlusion", "Skips occlusion culling, against the previous frame's depth on the GPU or a software-rasterized depth on the CPU.");
+	parser.addOptions({maxFpsOption, continuousOption, modelOption, benchmarkOption, framesOption, sizeOption, outputOption,
+					   traceOption, noIndirectOption, cpuCullingOption, noOcclusionOption});
+	parser.process(app);
+
+	const auto tracePath = parser.value(traceOption);
+	if (!tracePath.isEmpty())
+	{
+		if (trace::available())
+		{
+			trace::start();
+		}
+		else
+		{
+			std::cout << "--trace ignored, built without APP_ENABLE_TRACING" << std::endl;
+		}
+	}
+	// Writes the trace once the run is over, whichever way it ends.
+	const auto finish = [&tracePath](const int exitCode) {
+		if (!tracePath.isEmpty() && trace::available())
+		{
+			trace::stop(tracePath);
+		}
+		return exitCode;
+	};
+
 	// Set default surface format.
 	QSurfaceFormat format;
 	format.setSamples(g_sampels);
@@ -23,10 +67,44 @@ int main(int argc, char ** argv)
 	format.setProfile(QSurfaceFormat::CoreProfile);
 	QSurfaceFormat::setDefaultFormat(format);
 
+	if (parser.isSet(benchmarkOption))
+	{
+		BenchmarkOptions options;
+		options.model = parser.value(modelOption);
+		options.output = parser.value(outputOption);
+		options.frames = parser.value(framesOption).toULongLong();
+		options.indirect = !parser.isSet(noIndirectOption);
+		options.gpuCulling = !parser.isSet(cpuCullingOption);
+		options.occlusion = !parser.isSet(noOcclusionOption);
+		const auto size = parser.value(sizeOption).split('x');
+		auto widthValid = false;
+		auto heightValid = false;
+		if (size.size() == 2)
+		{
+			options.width = size[0].toInt(&widthValid);
+			options.height = size[1].toInt(&heightValid);
+		}
+		if (options.model.isEmpty() || options.frames == 0 || !widthValid || !heightValid
+			|| options.width <= 0 || options.height <= 0)
+		{
+			parser.showHelp(1);
+		}
+		return finish(runBenchmark(options));
+	}
+
 	// Now create window.
 	MainWindow window;
+	if (parser.isSet(modelOption))
+	{
+		window.renderWindow()->load(parser.value(modelOption).toStdString());
+	}
+	window.renderWindow()->setMaxFps(parser.value(maxFpsOption).toDouble());
+	window.renderWindow()->setContinuous(parser.isSet(continuousOption));
+	window.renderWindow()->setIndirectDraws(!parser.isSet(noIndirectOption));
+	window.renderWindow()->setGpuCulling(!parser.isSet(cpuCullingOption));
+	window.renderWindow()->setOcclusionCulling(!parser.isSet(noOcclusionOption));
 	window.resize(640, 480);
 	window.show();
 
-	return app.exec();
+	return finish(app.exec());
 }
\ No newline at end of file
@@ -57,8 +57,14 @@ MainWindow::MainWindow()
 	spotSlider->setMaximum(Window::MAX_SPOT);
 	spotSlider->setValue(Window::DEFAULT_SPOT);
 
-	fpsLabel_ = new QLabel();
-	fpsLabel_->setText("...");
+	frameTimesLabel_ = new QLabel();
+	frameTimesLabel_->setText("...");
+
+	scopeTimingsLabel_ = new QLabel();
+	callStatsLabel_ = new QLabel();
+	hoverLabel_ = new QLabel();
+
+	loadingLabel_ = new QLabel();
 
 	QGridLayout* formLayout = new QGridLayout();
 
@@ -80,7 +86,12 @@ MainWindow::MainWindow()
 	formLayout->addWidget(sunLabel, 5, 0);
 	formLayout->addWidget(sunSlider, 5, 1);
 
-	formLayout->addWidget(fpsLabel_, 6, 0);
+	formLayout->addWidget(frameTimesLabel_, 6, 0);
+	formLayout->addWidget(loadingLabel_, 6, 1);
+
+	formLayout->addWidget(scopeTimingsLabel_, 7, 0, 1, 2);
+	formLayout->addWidget(callStatsLabel_, 8, 0, 1, 2);
+	formLayout->addWidget(hoverLabel_, 9, 0, 1, 2);
 
 	QSurfaceFormat format;
 	format.setSamples(g_sampels);
@@ -96,9 +107,15 @@ MainWindow::MainWindow()
 	connect(ambientSlider, &QSlider::valueChanged, windowWidget, &Window::setAmbient);
 	connect(lightXSlider, &QSlider::valueChanged, windowWidget, &Window::setLightX);
 	connect(lightZSlider, &QSlider::valueChanged, windowWidget, &Window::setLightZ);
-	connect(windowWidget, &Window::updateFPS, this, &MainWindow::updateFPS);
+	connect(windowWidget, &Window::updateFrameTimes, this, &MainWindow::updateFrameTimes);
+	connect(windowWidget, &Window::updateScopeTimings, this, &MainWindow::updateScopeTimings);
+	connect(windowWidget, &Window::updateCallStats, this, &MainWindow::updateCallStats);
+	connect(windowWidget, &Window::updateLoadingProgress, this, &MainWindow::updateLoadingProgress);
+	connect(windowWidget, &Window::updateLoadingError, this, &MainWindow::updateLoadingError);
+	connect(windowWidget, &Window::updateHover, this, &MainWindow::updateHover);
 
 	setCentralWidget(windowWidget);
+	renderWindow_ = windowWidget;
 
 	auto dock = new QDockWidget;
 	auto settingsWidget = new QWidget;
@@ -110,7 +127,46 @@ MainWindow::MainWindow()
 	this->addDockWidget(Qt::BottomDockWidgetArea, dock);
 }
 
-void MainWindow::updateFPS(uint fps)
+Window * MainWindow::renderWindow() const
+{
+	return renderWindow_;
+}
+
+void MainWindow::updateFrameTimes(FrameTimeStats stats)
 {
-	fpsLabel_->setText(QString::asprintf("FPS:%u", fps));
-}
\ No newline at end of file
+	frameTimesLabel_->setText(QString::asprintf("Frame ms p50:%.2f p95:%.2f p99:%.2f max:%.2f hitches:%zu/%zu",
+		stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs, stats.hitches, stats.frames));
+}
+
+void MainWindow::updateScopeTimings(std::vector<GpuTimer::ScopeTiming> timings)
+{
+	QString text = "CPU/GPU ms";
+	for (const auto & timing: timings)
+	{
+		text += QString::asprintf(" %s:%.2f/%.2f", timing.name, timing.cpuMs, timing.gpuMs);
+	}
+	scopeTimingsLabel_->setText(text);
+}
+
+void MainWindow::updateCallStats(GLCallStats stats, CullStats cull)
+{
+	callStatsLabel_->setText(QString::asprintf("Visible:%zu/%zu Occluded:%zu Draws:%zu Triangles:%zu GL calls:%zu State changes:%zu Redundant binds:%zu",
+		cull.visible, cull.tested, cull.occluded, stats.drawCalls, stats.triangles, stats.totalCalls(), stats.stateChanges, stats.redundantBinds));
+}
+
+void MainWindow::updateLoadingProgress(uint percent)
+{
+	loadingLabel_->setText(percent < 100 ? QString::asprintf("Loading: %u%%", percent) : QString());
+}
+
+void MainWindow::updateLoadingError(QString error)
+{
+	loadingLabel_->setText("Loading failed: " + error);
+}
+void MainWindow::updateHover(std::optional<Picker::Hit> hit, qint64 pickNs)
+{
+	const auto micros = static_cast<double>(pickNs) / 1e3;
+	hoverLabel_->setText(hit ? QString::asprintf("Hover: node %u primitive %u triangle %u at %.3f (%.1f us)", hit->node,
+												 hit->primitive, hit->triangle, hit->distance, micros)
+							 : QString::asprintf("Hover: nothing (%.1f us)", micros));
+}
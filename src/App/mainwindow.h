@@ -1,18 +1,40 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "frametimes.h"
+#include "frustumculling.h"
+#include "glcallcounter.h"
+#include "gputimer.h"
+#include "picker.h"
+
 #include <QMainWindow>
 #include <QLabel>
 
+#include <optional>
+
+class Window;
+
 class MainWindow : public QMainWindow
 {
 	Q_OBJECT
 public:
 	MainWindow();
+
+	[[nodiscard]] Window * renderWindow() const;
 public slots:
-	void updateFPS(uint);
+	void updateFrameTimes(FrameTimeStats);
+	void updateScopeTimings(std::vector<GpuTimer::ScopeTiming>);
+	void updateCallStats(GLCallStats, CullStats);
+	void updateLoadingProgress(uint);
+	void updateLoadingError(QString);
+	void updateHover(std::optional<Picker::Hit>, qint64 pickNs);
 private:
-	QLabel* fpsLabel_;
+	QLabel* frameTimesLabel_;
+	QLabel* scopeTimingsLabel_;
+	QLabel* callStatsLabel_;
+	QLabel* hoverLabel_;
+	QLabel* loadingLabel_;
+	Window* renderWindow_;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -0,0 +1,525 @@
+#include "modelcache.h"
+#include "trace.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <tinygltf/tiny_gltf.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+namespace
+{
+
+constexpr std::array<char, 8> g_magic = {'G', 'L', 'T', 'F', 'C', 'A', 'C', 'H'};
+// Bump on any change of the layout below or of the SceneData records.
+constexpr uint32_t g_version = 5;
+constexpr uint64_t g_blobAlignment = 64;
+
+enum Section : uint32_t
+{
+	Dependencies,
+	BufferViews,
+	Attributes,
+	Primitives,
+	Materials,
+	Meshes,
+	Nodes,
+	Draws,
+	Images,
+	Levels,
+	SectionCount
+};
+
+struct SectionEntry
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct FileHeader
+{
+	std::array<char, 8> magic;
+	uint32_t version;
+	std::array<unsigned char, 20> sourceHash;
+	std::array<uint32_t, 2> reserved;
+	std::array<SectionEntry, SectionCount> sections;
+};
+
+// Offsets of blobs are absolute file offsets.
+struct BlobRecord
+{
+	uint32_t target;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct ImageRecord
+{
+	int32_t width;
+	int32_t height;
+	uint32_t format;
+	uint32_t type;
+	uint32_t firstLevel;
+	uint32_t levelCount;
+};
+
+static_assert(std::is_trivially_copyable_v<SceneData::Attribute>);
+static_assert(std::is_trivially_copyable_v<SceneData::Primitive>);
+static_assert(std::is_trivially_copyable_v<SceneData::Material>);
+static_assert(std::is_trivially_copyable_v<SceneData::Mesh>);
+static_assert(std::is_trivially_copyable_v<SceneData::Node>);
+static_assert(std::is_trivially_copyable_v<SceneData::Draw>);
+
+struct MappedStorage
+{
+	std::unique_ptr<QFile> file;
+	uchar * data = nullptr;
+
+	~MappedStorage()
+	{
+		if (data)
+		{
+			file->unmap(data);
+		}
+	}
+};
+
+uint64_t align(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+QByteArray fileHash(const QString & path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return {};
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(&file);
+	return hash.result();
+}
+
+// Hash over the .gltf file and every file it references, in reference order.
+std::optional<QByteArray> sourceHash(const QString & gltfPath, const QByteArray & gltfHash,
+									 const std::vector<std::string> & dependencies)
+{
+	const QDir baseDir = QFileInfo(gltfPath).absoluteDir();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(gltfHash);
+
+	for (const auto & dependency: dependencies)
+	{
+		const auto dependencyHash = fileHash(baseDir.filePath(QString::fromStdString(dependency)));
+		if (dependencyHash.isEmpty())
+		{
+			return std::nullopt;
+		}
+		hash.addData(dependency.c_str(), static_cast<int>(dependency.size()));
+		hash.addData(dependencyHash);
+	}
+	return hash.result();
+}
+
+std::vector<std::string> collectDependencies(const tinygltf::Model & model)
+{
+	std::vector<std::string> dependencies;
+	const auto add = [&dependencies](const std::string & uri) {
+		std::string decoded;
+		if (uri.empty() || tinygltf::IsDataURI(uri) || !tinygltf::URIDecode(uri, &decoded, nullptr))
+		{
+			return;
+		}
+		dependencies.push_back(decoded);
+	};
+
+	for (const auto & buffer: model.buffers)
+	{
+		add(buffer.uri);
+	}
+	for (const auto & image: model.images)
+	{
+		add(image.uri);
+	}
+	return dependencies;
+}
+
+QString entryPath(const QString & directory, const QByteArray & gltfHash)
+{
+	return QDir(directory).filePath(QString::fromLatin1(gltfHash.toHex()) + ".scene");
+}
+
+template <typename T>
+bool readTable(std::vector<T> & out, const uchar * data, uint64_t fileSize, const SectionEntry & entry)
+{
+	if (entry.offset > fileSize || entry.size > fileSize - entry.offset || entry.size % sizeof(T) != 0)
+	{
+		return false;
+	}
+	out.resize(entry.size / sizeof(T));
+	std::memcpy(out.data(), data + entry.offset, entry.size);
+	return true;
+}
+
+// Whether every index between the records of scene stays within its table,
+// so a damaged entry is rebuilt instead of read out of bounds later.
+bool validIndices(const SceneData & scene)
+{
+	const auto index = [](int64_t value, size_t size) { return value >= 0 && static_cast<uint64_t>(value) < size; };
+	const auto optionalIndex = [&index](int32_t value, size_t size) { return value == -1 || index(value, size); };
+	const auto range = [](uint64_t first, uint64_t count, size_t size) { return first <= size && count <= size - first; };
+
+	for (const auto & attribute: scene.attributes)
+	{
+		if (!index(attribute.bufferView, scene.bufferViews.size()))
+		{
+			return false;
+		}
+	}
+	for (const auto & primitive: scene.primitives)
+	{
+		if (!index(primitive.indexBufferView, scene.bufferViews.size())
+			|| !optionalIndex(primitive.material, scene.materials.size())
+			|| !range(primitive.firstAttribute, primitive.attributeCount, scene.attributes.size()))
+		{
+			return false;
+		}
+	}
+	for (const auto & material: scene.materials)
+	{
+		for (const auto image: {material.baseColorImage, material.normalImage, material.metallicRoughnessImage})
+		{
+			if (!optionalIndex(image, scene.images.size()))
+			{
+				return false;
+			}
+		}
+	}
+	for (const auto & mesh: scene.meshes)
+	{
+		if (!range(mesh.firstPrimitive, mesh.primitiveCount, scene.primitives.size()))
+		{
+			return false;
+		}
+	}
+	for (size_t i = 0; i < scene.nodes.size(); ++i)
+	{
+		// Parents precede their children.
+		if (!optionalIndex(scene.nodes[i].parent, i))
+		{
+			return false;
+		}
+	}
+	for (const auto & draw: scene.draws)
+	{
+		if (!index(draw.node, scene.nodes.size()) || !index(draw.primitive, scene.primitives.size()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+class Writer
+{
+public:
+	explicit Writer(QSaveFile & file)
+		: file_{file}
+	{
+	}
+
+	bool write(const void * data, uint64_t size)
+	{
+		pos_ += size;
+		return file_.write(static_cast<const char *>(data), static_cast<qint64>(size)) == static_cast<qint64>(size);
+	}
+
+	template <typename T>
+	bool write(const std::vector<T> & table)
+	{
+		return write(table.data(), table.size() * sizeof(T));
+	}
+
+	bool padTo(uint64_t offset)
+	{
+		static constexpr std::array<char, g_blobAlignment> zeros{};
+		while (pos_ < offset)
+		{
+			if (!write(zeros.data(), std::min<uint64_t>(zeros.size(), offset - pos_)))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	QSaveFile & file_;
+	uint64_t pos_ = 0;
+};
+
+}// namespace
+
+ModelCache::ModelCache(QString directory)
+	: directory_{std::move(directory)}
+{
+}
+
+QString ModelCache::defaultDirectory()
+{
+	return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("models");
+}
+
+std::optional<SceneData> ModelCache::load(const QString & gltfPath) const
+{
+	TRACE_SCOPE("ModelCache::load");
+	const auto gltfHash = fileHash(gltfPath);
+	if (gltfHash.isEmpty())
+	{
+		return std::nullopt;
+	}
+	const auto path = entryPath(directory_, gltfHash);
+	if (!QFile::exists(path))
+	{
+		return std::nullopt;
+	}
+
+	auto storage = std::make_shared<MappedStorage>();
+	storage->file = std::make_unique<QFile>(path);
+	if (!storage->file->open(QIODevice::ReadOnly))
+	{
+		return std::nullopt;
+	}
+	const auto fileSize = static_cast<uint64_t>(storage->file->size());
+	if (fileSize < sizeof(FileHeader))
+	{
+		return std::nullopt;
+	}
+	storage->data = storage->file->map(0, storage->file->size());
+	if (!storage->data)
+	{
+		return std::nullopt;
+	}
+	const uchar * data = storage->data;
+
+	FileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != g_magic || header.version != g_version)
+	{
+		return std::nullopt;
+	}
+
+	std::vector<char> dependencyNames;
+	if (!readTable(dependencyNames, data, fileSize, header.sections[Dependencies]))
+	{
+		return std::nullopt;
+	}
+	std::vector<std::string> dependencies;
+	for (auto it = dependencyNames.begin(); it != dependencyNames.end();)
+	{
+		const auto end = std::find(it, dependencyNames.end(), '\0');
+		dependencies.emplace_back(it, end);
+		it = end == dependencyNames.end() ? end : end + 1;
+	}
+
+	const auto hash = sourceHash(gltfPath, gltfHash, dependencies);
+	if (!hash || hash->size() != static_cast<int>(header.sourceHash.size())
+		|| std::memcmp(hash->constData(), header.sourceHash.data(), header.sourceHash.size()) != 0)
+	{
+		std::cout << "Model cache is stale: " << path.toStdString() << std::endl;
+		return std::nullopt;
+	}
+
+	SceneData scene;
+	std::vector<BlobRecord> bufferViews;
+	std::vector<ImageRecord> images;
+	std::vector<SectionEntry> levels;
+	if (!readTable(bufferViews, data, fileSize, header.sections[BufferViews])
+		|| !readTable(scene.attributes, data, fileSize, header.sections[Attributes])
+		|| !readTable(scene.primitives, data, fileSize, header.sections[Primitives])
+		|| !readTable(scene.materials, data, fileSize, header.sections[Materials])
+		|| !readTable(scene.meshes, data, fileSize, header.sections[Meshes])
+		|| !readTable(scene.nodes, data, fileSize, header.sections[Nodes])
+		|| !readTable(scene.draws, data, fileSize, header.sections[Draws])
+		|| !readTable(images, data, fileSize, header.sections[Images])
+		|| !readTable(levels, data, fileSize, header.sections[Levels]))
+	{
+		return std::nullopt;
+	}
+
+	const auto blob = [data, fileSize](uint64_t offset, uint64_t size) -> std::optional<SceneData::Bytes> {
+		if (offset > fileSize || size > fileSize - offset)
+		{
+			return std::nullopt;
+		}
+		return SceneData::Bytes(data + offset, size);
+	};
+
+	for (const auto & record: bufferViews)
+	{
+		const auto bytes = blob(record.offset, record.size);
+		if (!bytes)
+		{
+			return std::nullopt;
+		}
+		scene.bufferViews.push_back({record.target, *bytes});
+	}
+
+	for (const auto & record: images)
+	{
+		SceneData::Image image{record.width, record.height, record.format, record.type, {}};
+		if (record.firstLevel > levels.size() || record.levelCount > levels.size() - record.firstLevel)
+		{
+			return std::nullopt;
+		}
+		for (uint32_t i = 0; i < record.levelCount; ++i)
+		{
+			const auto & level = levels[record.firstLevel + i];
+			const auto bytes = blob(level.offset, level.size);
+			if (!bytes)
+			{
+				return std::nullopt;
+			}
+			image.levels.push_back(*bytes);
+		}
+		scene.images.push_back(std::move(image));
+	}
+	if (!validIndices(scene))
+	{
+		return std::nullopt;
+	}
+
+	scene.storage = std::move(storage);
+	std::cout << "Loaded cached scene: " << path.toStdString() << std::endl;
+	return scene;
+}
+
+bool ModelCache::store(const QString & gltfPath, const tinygltf::Model & model, const SceneData & scene) const
+{
+	TRACE_SCOPE("ModelCache::store");
+	const auto gltfHash = fileHash(gltfPath);
+	if (gltfHash.isEmpty() || !QDir().mkpath(directory_))
+	{
+		return false;
+	}
+	const auto path = entryPath(directory_, gltfHash);
+
+	const auto dependencies = collectDependencies(model);
+	const auto hash = sourceHash(gltfPath, gltfHash, dependencies);
+	if (!hash)
+	{
+		return false;
+	}
+
+	FileHeader header{};
+	header.magic = g_magic;
+	header.version = g_version;
+	std::memcpy(header.sourceHash.data(), hash->constData(), std::min<size_t>(header.sourceHash.size(), hash->size()));
+
+	std::vector<char> dependencyNames;
+	for (const auto & dependency: dependencies)
+	{
+		dependencyNames.insert(dependencyNames.end(), dependency.begin(), dependency.end());
+		dependencyNames.push_back('\0');
+	}
+
+	std::vector<BlobRecord> bufferViews;
+	std::vector<ImageRecord> images;
+	std::vector<SectionEntry> levels;
+	for (const auto & bufferView: scene.bufferViews)
+	{
+		bufferViews.push_back({bufferView.target, 0, 0, bufferView.bytes.size()});
+	}
+	for (const auto & image: scene.images)
+	{
+		images.push_back({image.width, image.height, image.format, image.type,
+						  static_cast<uint32_t>(levels.size()), static_cast<uint32_t>(image.levels.size())});
+		for (const auto & level: image.levels)
+		{
+			levels.push_back({0, level.size()});
+		}
+	}
+
+	// Lay out the tables right after the header, then every blob aligned.
+	uint64_t offset = sizeof(FileHeader);
+	const auto place = [&offset, &header](Section section, uint64_t size) {
+		header.sections[section] = {offset, size};
+		offset += size;
+	};
+	place(Dependencies, dependencyNames.size());
+	place(BufferViews, bufferViews.size() * sizeof(BlobRecord));
+	place(Attributes, scene.attributes.size() * sizeof(SceneData::Attribute));
+	place(Primitives, scene.primitives.size() * sizeof(SceneData::Primitive));
+	place(Materials, scene.materials.size() * sizeof(SceneData::Material));
+	place(Meshes, scene.meshes.size() * sizeof(SceneData::Mesh));
+	place(Nodes, scene.nodes.size() * sizeof(SceneData::Node));
+	place(Draws, scene.draws.size() * sizeof(SceneData::Draw));
+	place(Images, images.size() * sizeof(ImageRecord));
+	place(Levels, levels.size() * sizeof(SectionEntry));
+
+	for (auto & record: bufferViews)
+	{
+		record.offset = align(offset, g_blobAlignment);
+		offset = record.offset + record.size;
+	}
+	for (auto & level: levels)
+	{
+		level.offset = align(offset, g_blobAlignment);
+		offset = level.offset + level.size;
+	}
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	Writer writer(file);
+	bool ok = writer.write(&header, sizeof(header))
+		&& writer.write(dependencyNames)
+		&& writer.write(bufferViews)
+		&& writer.write(scene.attributes)
+		&& writer.write(scene.primitives)
+		&& writer.write(scene.materials)
+		&& writer.write(scene.meshes)
+		&& writer.write(scene.nodes)
+		&& writer.write(scene.draws)
+		&& writer.write(images)
+		&& writer.write(levels);
+
+	for (size_t i = 0; ok && i < bufferViews.size(); ++i)
+	{
+		ok = writer.padTo(bufferViews[i].offset)
+			&& writer.write(scene.bufferViews[i].bytes.data(), bufferViews[i].size);
+	}
+	size_t levelIndex = 0;
+	for (const auto & image: scene.images)
+	{
+		for (const auto & level: image.levels)
+		{
+			ok = ok && writer.padTo(levels[levelIndex].offset)
+				&& writer.write(level.data(), level.size());
+			++levelIndex;
+		}
+	}
+
+	if (!ok || !file.commit())
+	{
+		std::cout << "Failed to write model cache: " << file.errorString().toStdString() << std::endl;
+		return false;
+	}
+	std::cout << "Stored scene cache: " << path.toStdString() << std::endl;
+	return true;
+}
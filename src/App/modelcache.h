@@ -0,0 +1,30 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include "scenedata.h"
+
+#include <QString>
+
+#include <optional>
+
+// On-disk cache of SceneData. Entries are named after the content hash of the
+// .gltf file and remember every external file it references (.bin buffers and
+// textures) together with a hash over all of them. A valid entry is memory
+// mapped and its buffers and mip levels are handed to GL without any copy, so
+// warm starts skip JSON parsing and image decoding entirely.
+class ModelCache
+{
+public:
+	explicit ModelCache(QString directory);
+
+	// Returns nullopt if there is no entry or any source file changed since it was written.
+	[[nodiscard]] std::optional<SceneData> load(const QString & gltfPath) const;
+	bool store(const QString & gltfPath, const tinygltf::Model & model, const SceneData & scene) const;
+
+	[[nodiscard]] static QString defaultDirectory();
+
+private:
+	QString directory_;
+};
+
+#endif // MODELCACHE_H
@@ -0,0 +1,190 @@
+#include "modelloader.h"
+#include "modelcache.h"
+#include "trace.h"
+#include "workerpool.h"
+
+#include <tinygltf/stb_image.h>
+#include <tinygltf/tiny_gltf.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+
+// tinygltf image callback: keeps the encoded bytes (as_is) so decoding can be
+// fanned out over the worker pool after parsing instead of running serially.
+bool deferImageData(tinygltf::Image * image, const int /*imageIndex*/, std::string * /*err*/,
+					std::string * /*warn*/, int /*reqWidth*/, int /*reqHeight*/,
+					const unsigned char * bytes, int size, void * /*userData*/)
+{
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+// Decodes like tinygltf's default loader: always RGBA, 8 or 16 bits per channel.
+bool decodeImage(tinygltf::Image & image)
+{
+	TRACE_SCOPE("decodeImage");
+	const auto * encoded = image.image.data();
+	const auto size = static_cast<int>(image.image.size());
+	constexpr int components = STBI_rgb_alpha;
+
+	int width = -1;
+	int height = -1;
+	int channels = -1;
+	std::vector<unsigned char> pixels;
+	int bits = 8;
+	if (stbi_is_16_bit_from_memory(encoded, size))
+	{
+		auto * data = stbi_load_16_from_memory(encoded, size, &width, &height, &channels, components);
+		if (data)
+		{
+			const auto * begin = reinterpret_cast<const unsigned char *>(data);
+			pixels.assign(begin, begin + static_cast<size_t>(width) * height * components * sizeof(stbi_us));
+			stbi_image_free(data);
+		}
+		bits = 16;
+	}
+	else
+	{
+		auto * data = stbi_load_from_memory(encoded, size, &width, &height, &channels, components);
+		if (data)
+		{
+			pixels.assign(data, data + static_cast<size_t>(width) * height * components);
+			stbi_image_free(data);
+		}
+	}
+
+	image.as_is = false;
+	if (pixels.empty())
+	{
+		std::cout << "Failed to decode image: " << image.uri << ": " << stbi_failure_reason() << std::endl;
+		image.image.clear();
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.component = components;
+	image.bits = bits;
+	image.pixel_type = bits == 16 ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT : TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+	image.image = std::move(pixels);
+	return true;
+}
+
+std::shared_ptr<tinygltf::Model> loadModel(const std::string & filename, std::string & error)
+{
+	TRACE_SCOPE("loadModel");
+	auto model = std::make_shared<tinygltf::Model>();
+	tinygltf::TinyGLTF loader;
+	loader.SetImageLoader(&deferImageData, nullptr);
+	std::string err;
+	std::string warn;
+
+	bool res = false;
+	{
+		TRACE_SCOPE("tinygltf::LoadASCIIFromFile");
+		res = loader.LoadASCIIFromFile(model.get(), &err, &warn, filename);
+	}
+	if (!warn.empty())
+	{
+		std::cout << "WARN: " << warn << std::endl;
+	}
+
+	if (!err.empty())
+	{
+		std::cout << "ERR: " << err << std::endl;
+	}
+
+	if (!res)
+	{
+		std::cout << "Failed to load glTF: " << filename << std::endl;
+		error = err.empty() ? "cannot read " + filename : err;
+		return nullptr;
+	}
+
+	WorkerPool::instance().parallelFor(model->images.size(), [&model](size_t i) {
+		if (model->images[i].as_is)
+		{
+			decodeImage(model->images[i]);
+		}
+	});
+
+	std::cout << "Loaded glTF: " << filename << std::endl;
+	return model;
+}
+
+std::unique_ptr<SceneData> loadScene(const std::string & filename, const QString & cacheDirectory, std::string & error)
+{
+	TRACE_SCOPE("loadScene");
+	const auto path = QString::fromStdString(filename);
+	const ModelCache cache(cacheDirectory);
+	if (!cacheDirectory.isEmpty())
+	{
+		if (auto scene = cache.load(path))
+		{
+			return std::make_unique<SceneData>(std::move(*scene));
+		}
+	}
+
+	const auto model = loadModel(filename, error);
+	if (!model)
+	{
+		return nullptr;
+	}
+
+	auto scene = std::make_unique<SceneData>(buildSceneData(model));
+	if (!cacheDirectory.isEmpty())
+	{
+		cache.store(path, *model, *scene);
+	}
+	return scene;
+}
+
+}// namespace
+
+ModelLoader::ModelLoader(QString cacheDirectory)
+	: cacheDirectory_{std::move(cacheDirectory)}
+{
+}
+
+ModelLoader::~ModelLoader()
+{
+	// std::future from std::async joins the worker on destruction.
+	if (future_.valid())
+	{
+		future_.wait();
+	}
+}
+
+void ModelLoader::load(std::string filename)
+{
+	future_ = std::async(std::launch::async, [filename = std::move(filename), cacheDirectory = cacheDirectory_] {
+		Result result;
+		result.scene = loadScene(filename, cacheDirectory, result.error);
+		return result;
+	});
+}
+
+bool ModelLoader::isLoading() const
+{
+	return future_.valid();
+}
+
+std::unique_ptr<SceneData> ModelLoader::takeScene()
+{
+	if (!future_.valid() || future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return nullptr;
+	}
+	auto result = future_.get();
+	error_ = std::move(result.error);
+	return std::move(result.scene);
+}
+
+const std::string & ModelLoader::error() const
+{
+	return error_;
+}
@@ -0,0 +1,46 @@
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include "scenedata.h"
+
+#include <QString>
+
+#include <future>
+#include <memory>
+#include <string>
+
+// Loads glTF files into SceneData on a worker thread, so JSON parsing and image
+// decoding never block the GUI/GL thread. The GL thread polls takeScene() once
+// per frame. With a cache directory set, warm starts are served by ModelCache.
+class ModelLoader
+{
+public:
+	explicit ModelLoader(QString cacheDirectory = {});
+	~ModelLoader();
+
+	ModelLoader(const ModelLoader &) = delete;
+	ModelLoader & operator=(const ModelLoader &) = delete;
+
+	void load(std::string filename);
+
+	[[nodiscard]] bool isLoading() const;
+
+	// Returns the scene once the worker has finished and nullptr while it
+	// is still running or if loading failed.
+	[[nodiscard]] std::unique_ptr<SceneData> takeScene();
+	// Why the last finished load produced no scene, empty if it did.
+	[[nodiscard]] const std::string & error() const;
+
+private:
+	struct Result
+	{
+		std::unique_ptr<SceneData> scene;
+		std::string error;
+	};
+
+	QString cacheDirectory_;
+	std::future<Result> future_;
+	std::string error_;
+};
+
+#endif // MODELLOADER_H
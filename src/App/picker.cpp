@@ -0,0 +1,306 @@
+#include "picker.h"
+#include "trace.h"
+#include "workerpool.h"
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+using Vec3 = std::array<float, 3>;
+
+Vec3 sub(const Vec3 & a, const Vec3 & b)
+{
+	return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+Vec3 cross(const Vec3 & a, const Vec3 & b)
+{
+	return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+float dot(const Vec3 & a, const Vec3 & b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Möller-Trumbore, both faces. Returns the ray parameter or infinity.
+float intersectTriangle(const Ray & ray, const Vec3 & v0, const Vec3 & v1, const Vec3 & v2)
+{
+	const auto miss = std::numeric_limits<float>::infinity();
+	const auto edge1 = sub(v1, v0);
+	const auto edge2 = sub(v2, v0);
+	const auto p = cross(ray.direction, edge2);
+	const auto determinant = dot(edge1, p);
+	if (determinant == 0.0f)
+	{
+		return miss;
+	}
+
+	const auto inverse = 1.0f / determinant;
+	const auto s = sub(ray.origin, v0);
+	const auto u = dot(s, p) * inverse;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return miss;
+	}
+	const auto q = cross(s, edge1);
+	const auto v = dot(ray.direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return miss;
+	}
+	const auto t = dot(edge2, q) * inverse;
+	return t >= 0.0f ? t : miss;
+}
+
+// The ray in the space matrix maps from. Affine maps keep the ray parameter,
+// so distances found in node space are distances along the world ray.
+std::optional<Ray> inverseTransform(const Ray & ray, const TransformHierarchy::Matrix & matrix)
+{
+	TransformHierarchy::Matrix inverse;
+	if (!invertAffine(matrix, inverse))
+	{
+		return std::nullopt;
+	}
+
+	Ray result;
+	for (size_t r = 0; r < 3; ++r)
+	{
+		result.origin[r] = inverse[12 + r];
+		result.direction[r] = 0.0f;
+		for (size_t c = 0; c < 3; ++c)
+		{
+			result.origin[r] += inverse[4 * c + r] * ray.origin[c];
+			result.direction[r] += inverse[4 * c + r] * ray.direction[c];
+		}
+	}
+	return result;
+}
+
+}// namespace
+
+struct Picker::State
+{
+	// Triangles of one primitive, views into the scene storage.
+	struct Mesh
+	{
+		SceneData::Bytes positions;// from the first vertex
+		size_t stride;
+		SceneData::Bytes indices;// from the first index
+		uint32_t indexType;
+		uint32_t triangleCount;
+		Bvh bvh;
+		std::atomic<bool> ready{false};
+
+		[[nodiscard]] uint32_t index(const size_t i) const
+		{
+			switch (indexType)
+			{
+				case GL_UNSIGNED_BYTE:
+					return indices[i];
+				case GL_UNSIGNED_SHORT:
+				{
+					uint16_t value;
+					std::memcpy(&value, indices.data() + i * sizeof(value), sizeof(value));
+					return value;
+				}
+				default:
+				{
+					uint32_t value;
+					std::memcpy(&value, indices.data() + i * sizeof(value), sizeof(value));
+					return value;
+				}
+			}
+		}
+
+		[[nodiscard]] Vec3 position(const uint32_t vertex) const
+		{
+			Vec3 result;
+			std::memcpy(result.data(), positions.data() + vertex * stride, sizeof(result));
+			return result;
+		}
+
+		[[nodiscard]] bool inRange(const uint32_t vertex) const
+		{
+			return vertex * stride + sizeof(Vec3) <= positions.size();
+		}
+
+		void build(const std::atomic<bool> & cancelled)
+		{
+			TRACE_SCOPE("Picker::build");
+			BoxList boxes;
+			boxes.reserve(triangleCount);
+			for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+			{
+				if (triangle % 4096 == 0 && cancelled.load(std::memory_order_relaxed))
+				{
+					return;
+				}
+
+				Aabb box{{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+				for (size_t corner = 0; corner < 3; ++corner)
+				{
+					const auto vertex = index(3 * static_cast<size_t>(triangle) + corner);
+					// Broken files stay unpickable rather than reading past the buffer.
+					if (!inRange(vertex))
+					{
+						return;
+					}
+					const auto point = position(vertex);
+					for (size_t axis = 0; axis < 3; ++axis)
+					{
+						box.min[axis] = std::min(box.min[axis], point[axis]);
+						box.max[axis] = std::max(box.max[axis], point[axis]);
+					}
+				}
+				boxes.add(box);
+			}
+			bvh.build(boxes);
+			ready.store(true, std::memory_order_release);
+		}
+	};
+
+	std::shared_ptr<const void> storage;
+	std::vector<std::unique_ptr<Mesh>> meshes;// per primitive, null if it has no triangles to pick
+	std::atomic<bool> cancelled{false};
+};
+
+Picker::Picker() = default;
+
+Picker::~Picker()
+{
+	clear();
+}
+
+void Picker::build(const SceneData & scene)
+{
+	clear();
+	state_ = std::make_shared<State>();
+	state_->storage = scene.storage;
+	state_->meshes.resize(scene.primitives.size());
+
+	for (size_t i = 0; i < scene.primitives.size(); ++i)
+	{
+		const SceneData::Primitive & primitive = scene.primitives[i];
+		if (primitive.mode != GL_TRIANGLES || primitive.indexBufferView < 0)
+		{
+			continue;
+		}
+
+		const SceneData::Attribute * position = nullptr;
+		for (uint32_t j = primitive.firstAttribute; j < primitive.firstAttribute + primitive.attributeCount; ++j)
+		{
+			if (scene.attributes[j].location == 0)
+			{
+				position = &scene.attributes[j];
+			}
+		}
+		// Quantized positions would need dequantizing, only plain floats are picked.
+		if (!position || position->type != GL_FLOAT || position->size != 3 || position->stride <= 0 ||
+			position->bufferView < 0)
+		{
+			continue;
+		}
+
+		const auto positions = scene.bufferViews[position->bufferView].bytes;
+		const auto indices = scene.bufferViews[primitive.indexBufferView].bytes;
+		const size_t indexSize = primitive.indexType == GL_UNSIGNED_BYTE ? 1 : primitive.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		if (position->offset > positions.size() || primitive.indexOffset > indices.size() ||
+			primitive.indexCount * indexSize > indices.size() - primitive.indexOffset)
+		{
+			continue;
+		}
+
+		auto mesh = std::make_unique<State::Mesh>();
+		mesh->positions = positions.subspan(position->offset);
+		mesh->stride = static_cast<size_t>(position->stride);
+		mesh->indices = indices.subspan(primitive.indexOffset);
+		mesh->indexType = primitive.indexType;
+		mesh->triangleCount = primitive.indexCount / 3;
+		state_->meshes[i] = std::move(mesh);
+	}
+
+	// Jobs keep the state alive, so a new scene or destruction only has to cancel them.
+	for (size_t i = 0; i < state_->meshes.size(); ++i)
+	{
+		if (state_->meshes[i])
+		{
+			WorkerPool::instance().submit([state = state_, i] { state->meshes[i]->build(state->cancelled); });
+		}
+	}
+}
+
+void Picker::clear()
+{
+	if (state_)
+	{
+		state_->cancelled.store(true, std::memory_order_relaxed);
+		state_.reset();
+	}
+}
+
+bool Picker::isReady() const
+{
+	if (!state_)
+	{
+		return false;
+	}
+	for (const auto & mesh: state_->meshes)
+	{
+		if (mesh && !mesh->ready.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+auto Picker::pick(const Ray & ray, const Bvh & draws, std::span<const DrawRecord> records,
+				  std::span<const TransformHierarchy::Matrix> worlds) const -> std::optional<Hit>
+{
+	TRACE_SCOPE("Picker::pick");
+	if (!state_)
+	{
+		return std::nullopt;
+	}
+
+	std::optional<Hit> hit;
+	const auto maxDistance = std::numeric_limits<float>::max();
+	draws.intersectRay(ray, maxDistance, [&](const uint32_t record, float) {
+		auto nearest = hit ? hit->distance : maxDistance;
+		const auto primitive = records[record].primitive;
+		const State::Mesh * mesh = primitive < state_->meshes.size() ? state_->meshes[primitive].get() : nullptr;
+		if (!mesh || !mesh->ready.load(std::memory_order_acquire))
+		{
+			return nearest;
+		}
+		const auto local = inverseTransform(ray, worlds[records[record].matrix]);
+		if (!local)
+		{
+			return nearest;
+		}
+
+		mesh->bvh.intersectRay(*local, nearest, [&](const uint32_t triangle, float) {
+			const auto base = 3 * static_cast<size_t>(triangle);
+			const auto t = intersectTriangle(*local, mesh->position(mesh->index(base)), mesh->position(mesh->index(base + 1)),
+											 mesh->position(mesh->index(base + 2)));
+			if (t < nearest)
+			{
+				nearest = t;
+				hit = Hit{record, records[record].matrix, primitive, triangle, t};
+			}
+			return nearest;
+		});
+		return nearest;
+	});
+	return hit;
+}
@@ -0,0 +1,57 @@
+#ifndef PICKER_H
+#define PICKER_H
+
+#include "bvh.h"
+#include "renderlist.h"
+#include "scenedata.h"
+#include "transformhierarchy.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
+// Ray picking against the triangles of a scene. A triangle hierarchy per
+// primitive is built on the worker pool in the background, reading indices
+// and positions straight from the scene buffer views; a primitive is not
+// pickable until its hierarchy is done. Rays are tested against the rest
+// pose, morphing is not taken into account.
+class Picker
+{
+public:
+	struct Hit
+	{
+		uint32_t record;// render list index
+		uint32_t node;
+		uint32_t primitive;
+		uint32_t triangle;
+		float distance;// along the ray, in units of its direction
+	};
+
+	Picker();
+	// Pending builds are cancelled, running ones finish on their own copy of the state.
+	~Picker();
+
+	Picker(const Picker &) = delete;
+	Picker & operator=(const Picker &) = delete;
+
+	// Starts indexing the triangle primitives of scene, dropping the previous one.
+	// The scene itself may be destroyed afterwards, its storage is shared.
+	void build(const SceneData & scene);
+	void clear();
+
+	// True once every primitive is indexed.
+	[[nodiscard]] bool isReady() const;
+
+	// Nearest triangle hit by the world-space ray among records, found
+	// through draws, the hierarchy over their world bounds. worlds are the
+	// node matrices DrawRecord::matrix indexes.
+	[[nodiscard]] std::optional<Hit> pick(const Ray & ray, const Bvh & draws, std::span<const DrawRecord> records,
+										  std::span<const TransformHierarchy::Matrix> worlds) const;
+
+private:
+	struct State;
+	std::shared_ptr<State> state_;
+};
+
+#endif // PICKER_H
@@ -0,0 +1,871 @@
+#include "renderer.h"
+#include "glcallcounter.h"
+#include "glstatecache.h"
+#include "trace.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numbers>
+#include <span>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+namespace {
+// Counts the calls of the render path, see Renderer::frameStats().
+static GLCallCounter funcs;
+// Bindings of the draw path, invalidated every frame.
+static GLStateCache glState{funcs};
+
+// Bytes handed to the driver per frame while a model is being uploaded.
+constexpr size_t g_uploadBudgetPerFrame = 4 * 1024 * 1024;
+// Below this many draws the flat SIMD test beats walking the hierarchy.
+constexpr size_t g_bvhCullMinDraws = 256;
+}
+
+namespace
+{
+
+// Alignment of every bufferView inside the arenas, enough for any attribute or index type.
+constexpr GLsizeiptr g_bufferViewAlignment = 16;
+
+// Texture units of the material textures, matching Renderer::GpuMaterial::textures.
+enum TextureUnit : GLint
+{
+	BaseColorUnit,
+	NormalUnit,
+	MetallicRoughnessUnit,
+	TextureUnitCount
+};
+
+// Unit of the InstanceBuffer texture, after the material units.
+constexpr GLint g_instanceUnit = TextureUnitCount;
+// Attribute of InstanceBuffer::indexBuffer(), after position, normal and texture coordinates.
+constexpr GLuint g_instanceIndexLocation = 3;
+
+// Sampled where a material has no texture: white, a flat normal, and full metallic-roughness.
+constexpr std::array<TextureCache::Color, TextureUnitCount> g_fallbackColors = {{
+	{255, 255, 255, 255},
+	{128, 128, 255, 255},
+	{255, 255, 255, 255},
+}};
+
+struct DrawUniforms
+{
+	GLint baseColorFactor;
+	GLint metallicRoughnessFactor;
+	GLint normalScale;
+	GLint instanceBase;
+};
+
+Renderer::GpuMaterial bindMaterial(TextureCache & textures, const SceneData::Material & material)
+{
+	return {
+		{textures.texture(material.baseColorImage, g_fallbackColors[BaseColorUnit]),
+		 textures.texture(material.normalImage, g_fallbackColors[NormalUnit]),
+		 textures.texture(material.metallicRoughnessImage, g_fallbackColors[MetallicRoughnessUnit])},
+		material.baseColorFactor,
+		{material.metallicFactor, material.roughnessFactor},
+		material.normalScale,
+	};
+}
+
+// Resolves the attributes of primitive against the arenas and picks the VAO of that layout.
+void bindPrimitive(Renderer::GpuModel & gpuModel, const SceneData & scene, const size_t primitiveIndex)
+{
+	TRACE_SCOPE("bindPrimitive");
+	const SceneData::Primitive & primitive = scene.primitives[primitiveIndex];
+
+	VertexLayout layout;
+	layout.reserve(primitive.attributeCount);
+	for (uint32_t i = 0; i < primitive.attributeCount; ++i)
+	{
+		const SceneData::Attribute & attribute = scene.attributes[primitive.firstAttribute + i];
+		const BufferArena::Allocation & allocation = gpuModel.bufferViews[attribute.bufferView];
+		layout.push_back({
+			.location = attribute.location,
+			.buffer = allocation.buffer,
+			.size = attribute.size,
+			.type = attribute.type,
+			.normalized = static_cast<GLboolean>(attribute.normalized ? GL_TRUE : GL_FALSE),
+			.stride = attribute.stride,
+			.offset = static_cast<GLintptr>(allocation.offset + attribute.offset),
+		});
+	}
+	// Per-instance record index, so draws can pick their matrix by base instance.
+	layout.push_back({
+		.location = g_instanceIndexLocation,
+		.buffer = gpuModel.instances->indexBuffer(),
+		.size = 1,
+		.type = GL_UNSIGNED_INT,
+		.normalized = GL_FALSE,
+		.stride = 0,
+		.offset = 0,
+		.divisor = 1,
+		.integer = true,
+	});
+
+	gpuModel.primitiveVaos[primitiveIndex] = gpuModel.vertexArrays->acquire(std::move(layout));
+}
+
+// How the primitives read a bufferView. glTF makes bufferView.target optional,
+// so the arena is picked by the accessors instead.
+enum class BufferViewUse : uint8_t
+{
+	Unused,
+	Vertex,
+	Index,
+};
+
+std::vector<BufferViewUse> bufferViewUses(const SceneData & scene)
+{
+	std::vector<BufferViewUse> uses(scene.bufferViews.size(), BufferViewUse::Unused);
+	for (const auto & attribute: scene.attributes)
+	{
+		uses[attribute.bufferView] = BufferViewUse::Vertex;
+	}
+	// A view read both ways goes to the index arena, any buffer can back attributes too.
+	for (const auto & primitive: scene.primitives)
+	{
+		uses[primitive.indexBufferView] = BufferViewUse::Index;
+	}
+	return uses;
+}
+
+BufferArena & bufferViewArena(Renderer::GpuModel & gpuModel, const BufferViewUse use)
+{
+	return use == BufferViewUse::Index ? *gpuModel.indexArena : *gpuModel.vertexArena;
+}
+
+// Allocates every used bufferView from the vertex or index arena.
+void allocateBufferViews(Renderer::GpuModel & gpuModel, const SceneData & scene, std::span<const BufferViewUse> uses)
+{
+	const auto aligned = [](size_t size) {
+		return static_cast<GLsizeiptr>((size + g_bufferViewAlignment - 1) / g_bufferViewAlignment * g_bufferViewAlignment);
+	};
+
+	for (size_t i = 0; i < scene.bufferViews.size(); ++i)
+	{
+		if (uses[i] != BufferViewUse::Unused)
+		{
+			bufferViewArena(gpuModel, uses[i]).reserve(aligned(scene.bufferViews[i].bytes.size()));
+		}
+	}
+
+	gpuModel.bufferViews.assign(scene.bufferViews.size(), {});
+	for (size_t i = 0; i < scene.bufferViews.size(); ++i)
+	{
+		if (uses[i] != BufferViewUse::Unused)
+		{
+			auto & arena = bufferViewArena(gpuModel, uses[i]);
+			gpuModel.bufferViews[i] = arena.allocate(aligned(scene.bufferViews[i].bytes.size()), g_bufferViewAlignment);
+		}
+	}
+}
+
+// World boxes of the records from their node-space boxes and the current
+// world matrices. Morphing moves vertices towards their direction on the
+// unit sphere, which stays within the union of the box and [-1, 1]^3.
+void updateBounds(Renderer::GpuModel & gpuModel)
+{
+	TRACE_SCOPE("updateBounds");
+	const auto records = gpuModel.renderList.records();
+	const auto worlds = gpuModel.transforms.worlds();
+	gpuModel.bounds.clear();
+	gpuModel.morphBounds.clear();
+	gpuModel.bounds.reserve(records.size());
+	gpuModel.morphBounds.reserve(records.size());
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		auto box = transformBox(gpuModel.localBounds[i], worlds[records[i].matrix]);
+		gpuModel.bounds.add(box);
+		for (size_t axis = 0; axis < 3; ++axis)
+		{
+			box.min[axis] = std::min(box.min[axis], -1.0f);
+			box.max[axis] = std::max(box.max[axis], 1.0f);
+		}
+		gpuModel.morphBounds.add(box);
+	}
+}
+
+// Resolves every draw of the scene to GL names and absolute offsets once,
+// so drawing a frame touches neither SceneData nor the allocation table.
+void compileRenderList(Renderer::GpuModel & gpuModel, const SceneData & scene, const GLuint program)
+{
+	gpuModel.renderList.clear();
+	gpuModel.renderList.reserve(scene.draws.size());
+	for (const auto & draw: scene.draws)
+	{
+		const SceneData::Primitive & primitive = scene.primitives[draw.primitive];
+		const BufferArena::Allocation & indices = gpuModel.bufferViews[primitive.indexBufferView];
+		const auto material = primitive.material >= 0 ? primitive.material : scene.materials.size();
+		gpuModel.renderList.add({
+			.program = program,
+			.vao = gpuModel.primitiveVaos[draw.primitive],
+			.indexBuffer = indices.buffer,
+			.mode = primitive.mode,
+			.indexType = primitive.indexType,
+			.indexCount = static_cast<GLsizei>(primitive.indexCount),
+			.indexOffset = static_cast<GLintptr>(indices.offset + primitive.indexOffset),
+			.material = static_cast<uint32_t>(material),
+			.matrix = draw.node,
+			.primitive = draw.primitive,
+		});
+	}
+	gpuModel.renderList.sort();
+
+	gpuModel.localBounds.clear();
+	gpuModel.localBounds.reserve(scene.draws.size());
+	for (const DrawRecord & record: gpuModel.renderList.records())
+	{
+		const SceneData::Primitive & primitive = scene.primitives[record.primitive];
+		gpuModel.localBounds.push_back({primitive.boundsMin, primitive.boundsMax});
+	}
+
+	gpuModel.transforms.reset(scene.nodes);
+	gpuModel.transforms.update();
+	gpuModel.instances->update(gpuModel.renderList.records(), gpuModel.transforms.worlds());
+	updateBounds(gpuModel);
+	gpuModel.bvh.build(gpuModel.bounds);
+	gpuModel.bvhMorphed = false;
+}
+
+// Splits binding of the scene into upload jobs executed on the GL thread by
+// the queue, a few per frame. Each bufferView is uploaded exactly once into
+// its range of a shared arena buffer, each image used by a material once
+// into the texture cache.
+void bindModel(UploadQueue & queue, Renderer::GpuModel & gpuModel, const SceneData & scene, const GLuint program)
+{
+	TRACE_SCOPE("bindModel");
+	auto uses = bufferViewUses(scene);
+	queue.push(0, [&gpuModel, &scene, uses] {
+		TRACE_SCOPE("bindModel: allocate");
+		gpuModel.vertexArrays = std::make_unique<VertexArrayCache>(funcs);
+		gpuModel.textures = std::make_unique<TextureCache>(funcs);
+		gpuModel.vertexArena = std::make_unique<BufferArena>(funcs);
+		gpuModel.indexArena = std::make_unique<BufferArena>(funcs);
+		gpuModel.instances = std::make_unique<InstanceBuffer>(funcs);
+		gpuModel.instances->create();
+		allocateBufferViews(gpuModel, scene, uses);
+	});
+
+	for (size_t i = 0; i < scene.bufferViews.size(); ++i)
+	{
+		const SceneData::BufferView & bufferView = scene.bufferViews[i];
+		const auto use = uses[i];
+		if (use == BufferViewUse::Unused)
+		{
+			continue;
+		}
+
+		queue.push(bufferView.bytes.size(), [&gpuModel, &bufferView, use, i] {
+			TRACE_SCOPE("bindModel: upload buffer");
+			bufferViewArena(gpuModel, use).upload(gpuModel.bufferViews[i], bufferView.bytes);
+		});
+	}
+
+	std::vector<bool> usedImages(scene.images.size(), false);
+	for (const auto & material: scene.materials)
+	{
+		for (const auto image: {material.baseColorImage, material.normalImage, material.metallicRoughnessImage})
+		{
+			if (image >= 0)
+			{
+				usedImages[image] = true;
+			}
+		}
+	}
+	for (size_t i = 0; i < scene.images.size(); ++i)
+	{
+		const SceneData::Image & image = scene.images[i];
+		if (!usedImages[i] || image.levels.empty())
+		{
+			continue;
+		}
+
+		size_t bytes = 0;
+		for (const auto & level: image.levels)
+		{
+			bytes += level.size();
+		}
+		queue.push(bytes, [&gpuModel, &image, i] {
+			TRACE_SCOPE("bindModel: upload texture");
+			gpuModel.textures->upload(i, image);
+		});
+	}
+
+	queue.push(0, [&gpuModel, &scene, program] {
+		TRACE_SCOPE("bindModel: compile");
+		gpuModel.primitiveVaos.assign(scene.primitives.size(), 0);
+		for (size_t i = 0; i < scene.primitives.size(); ++i)
+		{
+			bindPrimitive(gpuModel, scene, i);
+		}
+
+		gpuModel.materials.clear();
+		for (const auto & material: scene.materials)
+		{
+			gpuModel.materials.push_back(bindMaterial(*gpuModel.textures, material));
+		}
+		// glTF default material, used by primitives without one.
+		gpuModel.materials.push_back(bindMaterial(*gpuModel.textures, {-1, -1, -1, {1.0f, 1.0f, 1.0f, 1.0f}, 1.0f, 1.0f, 1.0f}));
+
+		compileRenderList(gpuModel, scene, program);
+	});
+}
+
+// Binds the program, material and geometry of record through the state
+// cache. material is the record whose uniforms are set on the current program,
+// returns true if the program changed.
+bool bindDrawState(const Renderer::GpuModel & gpuModel, const DrawUniforms & uniforms, const DrawRecord & record,
+				   uint32_t & material)
+{
+	// Material uniforms belong to the program, set them again after a switch.
+	const auto programChanged = glState.useProgram(record.program);
+	if (programChanged)
+	{
+		material = UINT32_MAX;
+	}
+
+	if (record.material != material)
+	{
+		material = record.material;
+		const Renderer::GpuMaterial & gpuMaterial = gpuModel.materials[material];
+		for (GLuint unit = 0; unit < TextureUnitCount; ++unit)
+		{
+			glState.bindTexture(unit, GL_TEXTURE_2D, gpuMaterial.textures[unit]);
+		}
+		funcs.glUniform4fv(uniforms.baseColorFactor, 1, gpuMaterial.baseColorFactor.data());
+		funcs.glUniform2fv(uniforms.metallicRoughnessFactor, 1, gpuMaterial.metallicRoughnessFactor.data());
+		funcs.glUniform1f(uniforms.normalScale, gpuMaterial.normalScale);
+	}
+
+	// Draws from the same arena block share the element buffer.
+	glState.bindVertexArray(record.vao);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, record.indexBuffer);
+	return programChanged;
+}
+
+// Iterates the compiled records whose visible flag is set; the state cache
+// skips whatever the previous record already bound. Adjacent visible records
+// of the same geometry become one instanced call reading their world
+// matrices from the instance buffer.
+void drawModel(const Renderer::GpuModel & gpuModel, const DrawUniforms & uniforms, std::span<const uint8_t> visible)
+{
+	TRACE_SCOPE("drawModel");
+	const auto records = gpuModel.renderList.records();
+	glState.bindTexture(g_instanceUnit, GL_TEXTURE_BUFFER, gpuModel.instances->texture());
+
+	uint32_t material = UINT32_MAX;
+	for (size_t i = 0; i < records.size();)
+	{
+		if (!visible[i])
+		{
+			++i;
+			continue;
+		}
+
+		const DrawRecord & record = records[i];
+		auto end = i + 1;
+		while (end < records.size() && visible[end] && sameGeometry(records[end], record))
+		{
+			++end;
+		}
+
+		bindDrawState(gpuModel, uniforms, record, material);
+		funcs.glUniform1ui(uniforms.instanceBase, static_cast<GLuint>(i));
+		funcs.glDrawElementsInstanced(record.mode, record.indexCount, record.indexType,
+									  BUFFER_OFFSET(record.indexOffset), static_cast<GLsizei>(end - i));
+		i = end;
+	}
+
+	// Leave no vertex array bound for the uploads, they bind index buffers too.
+	glState.bindVertexArray(0);
+	glState.activeTexture(0);
+}
+
+// drawModel for GL 4.3+: the commands already sit in commandBuffer from
+// commandOffset on, with the first record of their run as base instance, and
+// each state bucket is one glMultiDrawElementsIndirect. commands is the CPU
+// copy for the call counter, empty if only the GPU knows the instance counts.
+void drawModelIndirect(const Renderer::GpuModel & gpuModel, const DrawUniforms & uniforms, const GLuint commandBuffer,
+					   const GLintptr commandOffset, std::span<const IndirectDraws::Bucket> buckets,
+					   std::span<const DrawElementsIndirectCommand> commands, QOpenGLFunctions_4_3_Core & functions43)
+{
+	TRACE_SCOPE("drawModelIndirect");
+	const auto records = gpuModel.renderList.records();
+	glState.bindTexture(g_instanceUnit, GL_TEXTURE_BUFFER, gpuModel.instances->texture());
+	glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	uint32_t material = UINT32_MAX;
+	for (const auto & bucket: buckets)
+	{
+		const DrawRecord & record = records[bucket.record];
+		if (bindDrawState(gpuModel, uniforms, record, material))
+		{
+			funcs.glUniform1ui(uniforms.instanceBase, 0);
+		}
+		functions43.glMultiDrawElementsIndirect(
+			record.mode, record.indexType,
+			BUFFER_OFFSET(commandOffset + bucket.firstCommand * sizeof(DrawElementsIndirectCommand)),
+			static_cast<GLsizei>(bucket.commandCount), 0);
+		funcs.countMultiDraw(record.mode, commands.empty() ? commands : commands.subspan(bucket.firstCommand, bucket.commandCount));
+	}
+
+	glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glState.bindVertexArray(0);
+	glState.activeTexture(0);
+}
+
+}// namespace
+
+Renderer::Renderer()
+{
+	clock_.start();
+}
+
+Renderer::~Renderer() = default;
+
+void Renderer::initialize()
+{
+	funcs.initializeOpenGLFunctions();
+
+	// Configure shaders
+	program_ = std::make_unique<QOpenGLShaderProgram>();
+	program_->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/Shaders/diffuse.vs");
+	program_->addShaderFromSourceFile(QOpenGLShader::Fragment,
+									  ":/Shaders/diffuse.fs");
+	program_->link();
+
+	// Bind attributes
+	program_->bind();
+
+	gpuTimer_ = std::make_unique<GpuTimer>(funcs);
+
+	// Indirect draws need GL 4.3 even if the context was asked for 3.3 core;
+	// drivers such as Mesa hand out their highest core version anyway.
+	GLint major = 0;
+	GLint minor = 0;
+	funcs.glGetIntegerv(GL_MAJOR_VERSION, &major);
+	funcs.glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 3))
+	{
+		functions43_ = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_3_Core>();
+		if (functions43_ != nullptr && functions43_->initializeOpenGLFunctions())
+		{
+			indirectDraws_ = std::make_unique<IndirectDraws>(funcs);
+			indirectDraws_->create();
+			gpuCulling_ = std::make_unique<GpuCulling>(*functions43_);
+			if (!gpuCulling_->create())
+			{
+				gpuCulling_->release();
+				gpuCulling_.reset();
+			}
+			depthPyramid_ = std::make_unique<DepthPyramid>(*functions43_);
+			if (!depthPyramid_->create())
+			{
+				depthPyramid_->release();
+				depthPyramid_.reset();
+			}
+		}
+	}
+	std::cout << "GL " << major << '.' << minor << ", "
+			  << (gpuCulling_ ? "multi-draw indirect and compute culling available"
+				  : indirectDraws_ ? "multi-draw indirect available" : "drawing per instance run") << std::endl;
+
+	uniformBlocks_ = std::make_unique<UniformBlocks>(funcs);
+	uniformBlocks_->create();
+	uniformBlocks_->attach(program_->programId());
+
+	baseColorFactorUniform_ = program_->uniformLocation("base_color_factor");
+	metallicRoughnessFactorUniform_ = program_->uniformLocation("metallic_roughness_factor");
+	normalScaleUniform_ = program_->uniformLocation("normal_scale");
+	instanceBaseUniform_ = program_->uniformLocation("instance_base");
+
+	// Samplers read the units of Renderer::GpuMaterial::textures.
+	program_->setUniformValue("tex_2d", BaseColorUnit);
+	program_->setUniformValue("normal_tex", NormalUnit);
+	program_->setUniformValue("metallic_roughness_tex", MetallicRoughnessUnit);
+	program_->setUniformValue("instance_worlds", g_instanceUnit);
+
+	// Release all
+	program_->release();
+
+	// Еnable depth test and face culling
+	glState.setEnabled(GL_DEPTH_TEST, true);
+	glState.setEnabled(GL_CULL_FACE, true);
+
+	// Clear all FBO buffers
+	funcs.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Create camera
+	camera_ = Camera(800, 800, {9.5, 0.0, 1.0});
+}
+
+void Renderer::release()
+{
+	program_.reset();
+	if (gpuTimer_)
+	{
+		gpuTimer_->release();
+	}
+	if (uniformBlocks_)
+	{
+		uniformBlocks_->release();
+	}
+	if (indirectDraws_)
+	{
+		indirectDraws_->release();
+	}
+	if (gpuCulling_)
+	{
+		gpuCulling_->release();
+	}
+	if (depthPyramid_)
+	{
+		depthPyramid_->release();
+	}
+
+	releaseModel();
+}
+
+void Renderer::load(std::string filename)
+{
+	// Jobs of an unfinished upload point into the scene and model dropped here.
+	uploads_.clear();
+	releaseModel();
+	picker_.clear();
+	softwareOcclusion_.clear();
+	scene_.reset();
+	modelReady_ = false;
+	loader_.load(std::move(filename));
+}
+
+void Renderer::releaseModel()
+{
+	if (gpuModel_.vertexArrays)
+	{
+		gpuModel_.vertexArrays->release();
+		gpuModel_.textures->release();
+		gpuModel_.vertexArena->release();
+		gpuModel_.indexArena->release();
+		gpuModel_.instances->release();
+	}
+	gpuModel_ = {};
+}
+
+void Renderer::resize(const size_t width, const size_t height)
+{
+	// Configure viewport
+	funcs.glViewport(0, 0, static_cast<GLint>(width), static_cast<GLint>(height));
+	GLint framebuffer = 0;
+	funcs.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	framebuffer_ = static_cast<GLuint>(framebuffer);
+
+	// Update camera
+	camera_.resize(width, height);
+}
+
+void Renderer::updateLoading()
+{
+	if (auto scene = loader_.takeScene())
+	{
+		scene_ = std::move(scene);
+		picker_.build(*scene_);
+		softwareOcclusion_.build(*scene_);
+		uploads_.clear();
+		bindModel(uploads_, gpuModel_, *scene_, program_->programId());
+	}
+
+	if (!uploads_.empty())
+	{
+		uploads_.run(g_uploadBudgetPerFrame);
+		modelReady_ = uploads_.empty();
+		if (modelReady_ && indirectDraws_)
+		{
+			indirectDraws_->invalidate();
+		}
+		if (modelReady_ && gpuCulling_)
+		{
+			gpuCulling_->build(gpuModel_.renderList.records());
+			gpuCulling_->updateBounds(gpuModel_.bounds);
+		}
+		if (modelReady_ && depthPyramid_)
+		{
+			depthPyramid_->invalidate();
+		}
+	}
+}
+
+void Renderer::renderPlaceholder()
+{
+	// Pulse the background while the model is parsed and uploaded.
+	const auto phase = static_cast<float>(clock_.elapsed() % 1000) / 1000.0f;
+	const auto level = 0.1f + 0.05f * std::sin(phase * 2.0f * std::numbers::pi_v<float>);
+	funcs.glClearColor(level, level, level, 1.0f);
+	funcs.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	funcs.glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Renderer::render()
+{
+	TRACE_SCOPE("Renderer::render");
+	funcs.beginFrame();
+	gpuTimer_->beginFrame();
+
+	if (!modelReady_)
+	{
+		const auto scope = gpuTimer_->scope("upload");
+		updateLoading();
+	}
+
+	// Qt and the upload jobs bind through their own tables, the uniform blocks
+	// only touch GL_UNIFORM_BUFFER and reset it to 0.
+	glState.invalidate();
+
+	if (!modelReady_)
+	{
+		{
+			const auto scope = gpuTimer_->scope("placeholder");
+			renderPlaceholder();
+		}
+		gpuTimer_->endFrame();
+		frameStats_ = funcs.stats();
+		++frameIndex_;
+		return;
+	}
+
+	// Clear buffers
+	{
+		const auto scope = gpuTimer_->scope("clear");
+		funcs.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	if (camera_.dirty)
+	{
+		const auto fov = 60.0f;
+		const auto zNear = 0.1f;
+		const auto zFar = 100.0f;
+		auto [m, v, p, direction] = camera_.update(fov, zNear, zFar, frameIndex_);
+		renderState_.setCamera(m, v, p, camera_.position, direction);
+		const auto viewProjection = p * v * m;
+		frustum_ = Frustum::fromMatrix(viewProjection.constData());
+		std::copy_n(viewProjection.constData(), viewProjection_.size(), viewProjection_.begin());
+	}
+
+	usedIndirect_ = indirectDraws_ && indirectEnabled_;
+	usedGpuCulling_ = usedIndirect_ && gpuCulling_ && gpuCullingEnabled_;
+	{
+		TRACE_SCOPE("cullBoxes");
+		const auto morphed = renderState_.scene().morphingProgress > 0.0f;
+		const auto & bounds = morphed ? gpuModel_.morphBounds : gpuModel_.bounds;
+		auto boundsChanged = false;
+		// Nodes moved since the last frame: new world boxes, same tree topology.
+		if (gpuModel_.transforms.update())
+		{
+			gpuModel_.instances->update(gpuModel_.renderList.records(), gpuModel_.transforms.worlds());
+			updateBounds(gpuModel_);
+			gpuModel_.bvh.refit(bounds);
+			gpuModel_.bvhMorphed = morphed;
+			boundsChanged = true;
+		}
+		else if (morphed != gpuModel_.bvhMorphed)
+		{
+			gpuModel_.bvh.refit(bounds);
+			gpuModel_.bvhMorphed = morphed;
+			boundsChanged = true;
+		}
+		// The GPU copy follows even while culling on the CPU, so switching back needs no upload.
+		if (boundsChanged && gpuCulling_)
+		{
+			gpuCulling_->updateBounds(bounds);
+		}
+
+		if (!usedGpuCulling_)
+		{
+			visible_.resize(bounds.size());
+			if (bounds.size() < g_bvhCullMinDraws)
+			{
+				cullBoxes(frustum_, bounds, visible_);
+			}
+			else
+			{
+				gpuModel_.bvh.cullFrustum(frustum_, visible_);
+			}
+			cullStats_ = {visible_.size(), static_cast<size_t>(std::count(visible_.begin(), visible_.end(), uint8_t{1}))};
+
+			// Occluders are rasterized in the rest pose, morphed vertices may have moved out from behind them.
+			if (occlusionEnabled_ && !morphed)
+			{
+				const auto scope = gpuTimer_->scope("occlusion");
+				cullStats_.occluded = softwareOcclusion_.cull(viewProjection_, gpuModel_.renderList.records(),
+															  gpuModel_.transforms.worlds(), bounds, visible_);
+				cullStats_.visible -= cullStats_.occluded;
+			}
+		}
+	}
+
+	// Upload only the blocks changed by the camera or the slots since the last frame.
+	const auto dirty = renderState_.dirty();
+	uniformBlocks_->update((dirty & RenderState::CameraDirty) ? &renderState_.camera() : nullptr,
+						   (dirty & RenderState::SceneDirty) ? &renderState_.scene() : nullptr);
+	renderState_.clearDirty();
+
+	const auto records = gpuModel_.renderList.records();
+	const auto occlusion = usedGpuCulling_ && depthPyramid_ && occlusionEnabled_;
+	if (usedGpuCulling_)
+	{
+		const auto scope = gpuTimer_->scope("cull");
+		gpuCulling_->cull(frustum_, gpuModel_.instances->indexBuffer(), occlusion ? depthPyramid_.get() : nullptr);
+		slotsCompacted_ = true;
+		// The pass binds its program and buffers through the 4.3 table.
+		glState.invalidate();
+		cullStats_ = gpuCulling_->stats().value_or(CullStats{records.size(), records.size(), 0});
+	}
+	else if (slotsCompacted_)
+	{
+		gpuModel_.instances->resetIndices();
+		slotsCompacted_ = false;
+	}
+
+	// The program is bound by the draw loop with the first record.
+	const DrawUniforms uniforms{baseColorFactorUniform_, metallicRoughnessFactorUniform_, normalScaleUniform_,
+								instanceBaseUniform_};
+	{
+		const auto scope = gpuTimer_->scope("draw");
+		if (usedGpuCulling_)
+		{
+			drawModelIndirect(gpuModel_, uniforms, gpuCulling_->commandBuffer(), GpuCulling::g_commandOffset,
+							  gpuCulling_->buckets(), {}, *functions43_);
+		}
+		else if (usedIndirect_)
+		{
+			// Binds the command buffer past the state cache, so before the cache binds it this frame.
+			indirectDraws_->update(records, visible_);
+			drawModelIndirect(gpuModel_, uniforms, indirectDraws_->buffer(), 0, indirectDraws_->buckets(),
+							  indirectDraws_->commands(), *functions43_);
+		}
+		else
+		{
+			drawModel(gpuModel_, uniforms, visible_);
+		}
+	}
+
+	// Records the early pass found behind last frame's depth get a second
+	// chance against what was just drawn, the depth test of initialize() keeps
+	// the rest of the pass unchanged.
+	if (occlusion)
+	{
+		const auto scope = gpuTimer_->scope("occlusion");
+		depthPyramid_->build(framebuffer_, static_cast<GLsizei>(camera_.width), static_cast<GLsizei>(camera_.height),
+							 viewProjection_);
+		gpuCulling_->cullLate(gpuModel_.instances->indexBuffer(), *depthPyramid_);
+		glState.invalidate();
+		drawModelIndirect(gpuModel_, uniforms, gpuCulling_->lateCommandBuffer(), GpuCulling::g_commandOffset,
+						  gpuCulling_->buckets(), {}, *functions43_);
+	}
+	gpuTimer_->endFrame();
+	frameStats_ = funcs.stats();
+	++frameIndex_;
+}
+
+bool Renderer::isLoading() const
+{
+	return loader_.isLoading() || !uploads_.empty();
+}
+
+bool Renderer::isReady() const
+{
+	return modelReady_;
+}
+
+float Renderer::loadingProgress() const
+{
+	if (modelReady_)
+	{
+		return 1.0f;
+	}
+	return uploads_.empty() ? 0.0f : uploads_.progress();
+}
+
+const std::string & Renderer::loadError() const
+{
+	return loader_.error();
+}
+
+Camera & Renderer::camera()
+{
+	return camera_;
+}
+
+RenderState & Renderer::state()
+{
+	return renderState_;
+}
+
+const GLCallStats & Renderer::frameStats() const
+{
+	return frameStats_;
+}
+
+const GpuTimer & Renderer::gpuTimer() const
+{
+	return *gpuTimer_;
+}
+
+std::optional<Picker::Hit> Renderer::pick(const float x, const float y) const
+{
+	if (!modelReady_ || camera_.width == 0 || camera_.height == 0)
+	{
+		return std::nullopt;
+	}
+
+	// Unproject the pixel center on the near and far plane.
+	const auto ndcX = 2.0f * (x + 0.5f) / static_cast<float>(camera_.width) - 1.0f;
+	const auto ndcY = 1.0f - 2.0f * (y + 0.5f) / static_cast<float>(camera_.height);
+	const auto inverse = (camera_.projection * camera_.view * camera_.model).inverted();
+	const auto near = inverse.map(QVector3D{ndcX, ndcY, -1.0f});
+	const auto far = inverse.map(QVector3D{ndcX, ndcY, 1.0f});
+	const auto direction = (far - near).normalized();
+
+	const Ray ray{{near.x(), near.y(), near.z()}, {direction.x(), direction.y(), direction.z()}};
+	return picker_.pick(ray, gpuModel_.bvh, gpuModel_.renderList.records(), gpuModel_.transforms.worlds());
+}
+
+void Renderer::setIndirectDraws(const bool enabled)
+{
+	indirectEnabled_ = enabled;
+}
+
+bool Renderer::usesIndirectDraws() const
+{
+	return usedIndirect_;
+}
+
+void Renderer::setGpuCulling(const bool enabled)
+{
+	gpuCullingEnabled_ = enabled;
+}
+
+void Renderer::setOcclusionCulling(const bool enabled)
+{
+	occlusionEnabled_ = enabled;
+}
+
+bool Renderer::usesGpuCulling() const
+{
+	return usedGpuCulling_;
+}
+
+TransformHierarchy & Renderer::transforms()
+{
+	return gpuModel_.transforms;
+}
+
+const CullStats & Renderer::cullStats() const
+{
+	return cullStats_;
+}
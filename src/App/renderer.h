@@ -0,0 +1,184 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "bufferarena.h"
+#include "bvh.h"
+#include "camera.h"
+#include "depthpyramid.h"
+#include "frustumculling.h"
+#include "glcallcounter.h"
+#include "gpuculling.h"
+#include "gputimer.h"
+#include "indirectdraws.h"
+#include "instancebuffer.h"
+#include "modelcache.h"
+#include "modelloader.h"
+#include "picker.h"
+#include "renderlist.h"
+#include "renderstate.h"
+#include "softwareocclusion.h"
+#include "texturecache.h"
+#include "transformhierarchy.h"
+#include "uniformblocks.h"
+#include "uploadqueue.h"
+#include "vertexarraycache.h"
+
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Everything needed to load and draw the scene into whatever framebuffer is
+// bound, independent of the widget: the window and the headless benchmark
+// both drive it. All methods except the constructor require a current context.
+class Renderer
+{
+public:
+	// Material with its textures resolved, indexed by texture unit.
+	struct GpuMaterial
+	{
+		std::array<GLuint, 3> textures;// base color, normal, metallic-roughness
+		std::array<float, 4> baseColorFactor;
+		std::array<float, 2> metallicRoughnessFactor;
+		float normalScale;
+	};
+
+	// GL objects of the loaded scene.
+	struct GpuModel
+	{
+		std::unique_ptr<VertexArrayCache> vertexArrays;
+		std::unique_ptr<TextureCache> textures;
+		std::unique_ptr<BufferArena> vertexArena;
+		std::unique_ptr<BufferArena> indexArena;
+		std::unique_ptr<InstanceBuffer> instances;// world matrix of every record of renderList
+		std::vector<BufferArena::Allocation> bufferViews;// one per SceneData::bufferViews entry
+		std::vector<GLuint> primitiveVaos;// one per SceneData::primitives entry
+		std::vector<GpuMaterial> materials;// SceneData::materials plus the default material
+		RenderList renderList;// compiled by the last upload job
+		TransformHierarchy transforms;// of SceneData::nodes, DrawRecord::matrix indexes it
+		std::vector<Aabb> localBounds;// node-space box of every record of renderList
+		BoxList bounds;// world box of every record of renderList
+		BoxList morphBounds;// bounds grown by the sphere the morph pulls vertices to
+		Bvh bvh;// over bounds, refit to morphBounds while morphing
+		bool bvhMorphed = false;
+	};
+
+	Renderer();
+	~Renderer();
+
+	Renderer(const Renderer &) = delete;
+	Renderer & operator=(const Renderer &) = delete;
+
+	void initialize();
+	// Frees all GL objects, must be called before destruction.
+	void release();
+
+	// Parsing runs on a worker, render() uploads the result in per-frame batches.
+	// Drops the current model first, so the context must be current.
+	void load(std::string filename);
+
+	// Sets the viewport. The draw framebuffer bound now is the one the
+	// occlusion pass reads depth from, so render() must draw into it.
+	void resize(size_t width, size_t height);
+	// Draws a placeholder until the model is on the GPU, the scene afterwards.
+	void render();
+
+	// True while the model is parsed or uploaded.
+	[[nodiscard]] bool isLoading() const;
+	[[nodiscard]] bool isReady() const;
+	// Fraction of the upload done, 0 until parsing finished.
+	[[nodiscard]] float loadingProgress() const;
+	// Why the model could not be loaded, empty while loading and once ready.
+	[[nodiscard]] const std::string & loadError() const;
+
+	[[nodiscard]] Camera & camera();
+	[[nodiscard]] RenderState & state();
+	// GL calls of the last rendered frame made by the render path itself;
+	// uniform block updates and uploads go through the caches and are not seen.
+	// Triangles of GPU-culled draws are only known to the GPU and not counted.
+	[[nodiscard]] const GLCallStats & frameStats() const;
+	// Culling result of the last rendered frame; a few frames old when culled on the GPU.
+	[[nodiscard]] const CullStats & cullStats() const;
+	// CPU and GPU time of the passes of a recent frame, see GpuTimer.
+	[[nodiscard]] const GpuTimer & gpuTimer() const;
+
+	// Node transforms of the loaded scene, empty until it is on the GPU. Local
+	// matrices set between frames reach the world matrices, the bounds and the
+	// culling hierarchy at the start of the next render().
+	[[nodiscard]] TransformHierarchy & transforms();
+
+	// Draws each state bucket with one glMultiDrawElementsIndirect when the
+	// context is GL 4.3+ (the default), or per instance run like on GL 3.3.
+	void setIndirectDraws(bool enabled);
+	// True if the last frame was drawn with glMultiDrawElementsIndirect.
+	[[nodiscard]] bool usesIndirectDraws() const;
+	// Culls with GpuCulling when indirect draws are used and the context can
+	// run compute shaders (the default), on the CPU otherwise.
+	void setGpuCulling(bool enabled);
+	// True if the last frame was culled on the GPU.
+	[[nodiscard]] bool usesGpuCulling() const;
+	// Drops draws hidden behind others (the default): with GPU culling in two
+	// passes against a DepthPyramid, see GpuCulling, which needs the framebuffer
+	// to have depth; otherwise with SoftwareOcclusion, except while morphing.
+	void setOcclusionCulling(bool enabled);
+
+	// Triangle under the framebuffer pixel (x, y) of the last rendered frame,
+	// counted from the top left in device pixels like resize(), with the
+	// distance from the camera. Needs no context, nothing is hit while
+	// loading or before the triangle index of a primitive is built.
+	[[nodiscard]] std::optional<Picker::Hit> pick(float x, float y) const;
+
+private:
+	// Drives background loading, sets modelReady_ once the model is fully on the GPU.
+	void updateLoading();
+	// Frees the GL objects of the current model, the context must be current.
+	void releaseModel();
+	void renderPlaceholder();
+
+	Camera camera_;
+	RenderState renderState_;// camera and light parameters, uploaded when dirty
+	std::unique_ptr<UniformBlocks> uniformBlocks_;
+	std::unique_ptr<QOpenGLShaderProgram> program_;
+	std::unique_ptr<GpuTimer> gpuTimer_;
+	// Only resolved on GL 4.3+ contexts, owned by the context.
+	QOpenGLFunctions_4_3_Core * functions43_ = nullptr;
+	std::unique_ptr<IndirectDraws> indirectDraws_;
+	std::unique_ptr<GpuCulling> gpuCulling_;
+	std::unique_ptr<DepthPyramid> depthPyramid_;
+	bool indirectEnabled_ = true;
+	bool gpuCullingEnabled_ = true;
+	bool occlusionEnabled_ = true;
+	bool usedIndirect_ = false;
+	bool usedGpuCulling_ = false;
+	bool slotsCompacted_ = false;// instance slots hold GpuCulling output instead of the identity
+
+	GLint baseColorFactorUniform_ = -1;
+	GLint metallicRoughnessFactorUniform_ = -1;
+	GLint normalScaleUniform_ = -1;
+	GLint instanceBaseUniform_ = -1;
+
+	ModelLoader loader_{ModelCache::defaultDirectory()};
+	UploadQueue uploads_;
+	bool modelReady_ = false;
+
+	std::unique_ptr<SceneData> scene_;
+	GpuModel gpuModel_;
+	Picker picker_;
+	SoftwareOcclusion softwareOcclusion_;
+
+	GLCallStats frameStats_;
+	CullStats cullStats_;
+	Frustum frustum_{};// of the camera, in world space
+	DepthPyramid::Matrix viewProjection_{};// the frustum's matrix, column-major
+	std::vector<uint8_t> visible_;// per render list record
+	GLuint framebuffer_ = 0;// draw framebuffer of the last resize(), read by the occlusion pass
+	size_t frameIndex_ = 0;
+	QElapsedTimer clock_;
+};
+
+#endif // RENDERER_H
@@ -0,0 +1,61 @@
+#include "renderlist.h"
+
+#include <algorithm>
+#include <tuple>
+
+void RenderList::clear()
+{
+	records_.clear();
+}
+
+void RenderList::reserve(const size_t count)
+{
+	records_.reserve(count);
+}
+
+void RenderList::add(const DrawRecord & record)
+{
+	records_.push_back(record);
+}
+
+void RenderList::sort()
+{
+	std::stable_sort(records_.begin(), records_.end(), [](const DrawRecord & lhs, const DrawRecord & rhs) {
+		return std::tie(lhs.program, lhs.material, lhs.vao, lhs.indexBuffer, lhs.indexOffset, lhs.indexCount)
+			< std::tie(rhs.program, rhs.material, rhs.vao, rhs.indexBuffer, rhs.indexOffset, rhs.indexCount);
+	});
+}
+
+GLuint indexSize(const GLenum indexType)
+{
+	switch (indexType)
+	{
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_UNSIGNED_SHORT:
+			return 2;
+		default:
+			return 4;
+	}
+}
+
+bool sameState(const DrawRecord & lhs, const DrawRecord & rhs)
+{
+	return std::tie(lhs.program, lhs.material, lhs.vao, lhs.indexBuffer, lhs.mode, lhs.indexType)
+		== std::tie(rhs.program, rhs.material, rhs.vao, rhs.indexBuffer, rhs.mode, rhs.indexType);
+}
+
+bool sameGeometry(const DrawRecord & lhs, const DrawRecord & rhs)
+{
+	return sameState(lhs, rhs) && lhs.indexOffset == rhs.indexOffset && lhs.indexCount == rhs.indexCount;
+}
+
+std::span<const DrawRecord> RenderList::records() const
+{
+	return records_;
+}
+
+bool RenderList::empty() const
+{
+	return records_.empty();
+}
@@ -0,0 +1,71 @@
+#ifndef RENDERLIST_H
+#define RENDERLIST_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Everything one glDrawElements call needs, resolved to GL names and byte
+// offsets when the scene is bound, so the frame loop does no lookups.
+struct DrawRecord
+{
+	GLuint program;
+	GLuint vao;
+	GLuint indexBuffer;
+	GLenum mode;
+	GLenum indexType;
+	GLsizei indexCount;
+	GLintptr indexOffset;// in bytes, from the start of indexBuffer
+	uint32_t material;
+	uint32_t matrix;// index of the world matrix of the node
+	uint32_t primitive;// SceneData::primitives index, for the bounds
+};
+
+static_assert(std::is_trivially_copyable_v<DrawRecord>);
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER.
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;// in indices, not bytes
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20);
+
+// Contiguous array of draw records, compiled once after the scene is uploaded.
+class RenderList
+{
+public:
+	void clear();
+	void reserve(size_t count);
+	void add(const DrawRecord & record);
+
+	// Orders records by program, material, VAO, element buffer and index
+	// range, so draws sharing state are adjacent and the frame loop binds each
+	// change once, and occurrences of one primitive end up next to each other.
+	void sort();
+
+	[[nodiscard]] std::span<const DrawRecord> records() const;
+	[[nodiscard]] bool empty() const;
+
+private:
+	std::vector<DrawRecord> records_;
+};
+
+// Bytes per index of an indexType of DrawRecord.
+GLuint indexSize(GLenum indexType);
+
+// True if the records bind the same program, material, VAO and element
+// buffer and draw the same kind of primitives, so one multi-draw covers both.
+bool sameState(const DrawRecord & lhs, const DrawRecord & rhs);
+// True if the records only differ in their node, so they can be drawn as
+// instances of one call.
+bool sameGeometry(const DrawRecord & lhs, const DrawRecord & rhs);
+
+#endif // RENDERLIST_H
@@ -0,0 +1,127 @@
+#include "renderstate.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+std::array<float, 16> toArray(const QMatrix4x4 & matrix)
+{
+	std::array<float, 16> result;
+	std::copy_n(matrix.constData(), result.size(), result.begin());
+	return result;
+}
+
+std::array<float, 3> toArray(const QVector3D & vector)
+{
+	return {vector.x(), vector.y(), vector.z()};
+}
+
+}// namespace
+
+RenderState::RenderState()
+{
+	setSunPosition({g_defaultSunX, 2, g_defaultSunZ / 100.f});
+	setSunColor({1.0, 1.0, 1.0});
+	setSpotlightColor({1.0, 1.0, 1.0});
+	setSunLightCoef(g_defaultSunCoef);
+	setAmbientLightCoef(g_defaultAmbientCoef);
+	setSpotlightCoef(g_defaultSpotlightCoef);
+	setSpotlightAngles(g_defaultSpotlightAngle, g_defaultSpotlightAngle + g_defaultSpotlightAngle);
+	setMorphingProgress(0);
+}
+
+template <typename T>
+void RenderState::assign(T & field, const T & value, const DirtyBit bit)
+{
+	if (field != value)
+	{
+		field = value;
+		dirty_ |= bit;
+	}
+}
+
+void RenderState::setCamera(const QMatrix4x4 & m, const QMatrix4x4 & v, const QMatrix4x4 & p,
+							const QVector3D & position, const QVector3D & direction)
+{
+	assign(camera_.m, toArray(m), CameraDirty);
+	assign(camera_.v, toArray(v), CameraDirty);
+	assign(camera_.p, toArray(p), CameraDirty);
+	assign(camera_.spotlightPosition, toArray(position), CameraDirty);
+	assign(camera_.spotlightDirection, toArray(direction), CameraDirty);
+}
+
+void RenderState::setSunPosition(const QVector3D & position)
+{
+	assign(scene_.sunPosition, toArray(position), SceneDirty);
+}
+
+void RenderState::setSunColor(const QVector3D & color)
+{
+	assign(scene_.sunColor, toArray(color), SceneDirty);
+}
+
+void RenderState::setSpotlightColor(const QVector3D & color)
+{
+	assign(scene_.spotlightColor, toArray(color), SceneDirty);
+}
+
+void RenderState::setSunLightCoef(const float coef)
+{
+	assign(scene_.sunLightCoef, coef, SceneDirty);
+}
+
+void RenderState::setAmbientLightCoef(const float coef)
+{
+	assign(scene_.ambientLightCoef, coef, SceneDirty);
+}
+
+void RenderState::setSpotlightCoef(const float coef)
+{
+	assign(scene_.spotlightCoef, coef, SceneDirty);
+}
+
+void RenderState::setSpotlightAngles(const float first, const float second)
+{
+	if (first != spotlightFirstAngle_)
+	{
+		spotlightFirstAngle_ = first;
+		assign(scene_.spotlightFirstCos, std::cos((first / 10) * 100 / 180.0f), SceneDirty);
+	}
+	if (second != spotlightSecondAngle_)
+	{
+		spotlightSecondAngle_ = second;
+		assign(scene_.spotlightSecondCos, std::cos((second / 10) * 100 / 180.0f), SceneDirty);
+	}
+}
+
+void RenderState::setMorphingProgress(const float progress)
+{
+	assign(scene_.morphingProgress, progress, SceneDirty);
+}
+
+QVector3D RenderState::sunPosition() const
+{
+	return {scene_.sunPosition[0], scene_.sunPosition[1], scene_.sunPosition[2]};
+}
+
+const CameraBlock & RenderState::camera() const
+{
+	return camera_;
+}
+
+const SceneBlock & RenderState::scene() const
+{
+	return scene_;
+}
+
+uint32_t RenderState::dirty() const
+{
+	return dirty_;
+}
+
+void RenderState::clearDirty()
+{
+	dirty_ = 0;
+}
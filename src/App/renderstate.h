@@ -0,0 +1,67 @@
+#ifndef RENDERSTATE_H
+#define RENDERSTATE_H
+
+#include "uniformblocks.h"
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <cstdint>
+
+// Shader parameters set by the UI slots and the camera. Setters only record
+// values that actually changed; the renderer uploads the dirty blocks once per
+// frame and clears the bits, so idle frames upload nothing.
+class RenderState
+{
+public:
+	enum DirtyBit : uint32_t
+	{
+		CameraDirty = 1u << 0,
+		SceneDirty = 1u << 1,
+		AllDirty = CameraDirty | SceneDirty
+	};
+
+	// Light parameters the UI starts from, in the units of its sliders.
+	static constexpr float g_defaultSunX = 90;
+	static constexpr float g_defaultSunZ = 10;
+	static constexpr float g_defaultSunCoef = 160;
+	static constexpr float g_defaultAmbientCoef = 150;
+	static constexpr float g_defaultSpotlightCoef = 10;
+	static constexpr float g_defaultSpotlightAngle = 70;
+
+	// Starts from the defaults above with white lights and no morphing.
+	RenderState();
+
+	void setCamera(const QMatrix4x4 & m, const QMatrix4x4 & v, const QMatrix4x4 & p,
+				   const QVector3D & position, const QVector3D & direction);
+
+	void setSunPosition(const QVector3D & position);
+	void setSunColor(const QVector3D & color);
+	void setSpotlightColor(const QVector3D & color);
+	void setSunLightCoef(float coef);
+	void setAmbientLightCoef(float coef);
+	void setSpotlightCoef(float coef);
+	// Angles in the units of the UI, the cosines are computed here, on change only.
+	void setSpotlightAngles(float first, float second);
+	void setMorphingProgress(float progress);
+
+	[[nodiscard]] QVector3D sunPosition() const;
+
+	[[nodiscard]] const CameraBlock & camera() const;
+	[[nodiscard]] const SceneBlock & scene() const;
+
+	[[nodiscard]] uint32_t dirty() const;
+	void clearDirty();
+
+private:
+	template <typename T>
+	void assign(T & field, const T & value, DirtyBit bit);
+
+	CameraBlock camera_{};
+	SceneBlock scene_{};
+	float spotlightFirstAngle_ = -1.0f;
+	float spotlightSecondAngle_ = -1.0f;
+	uint32_t dirty_ = AllDirty;
+};
+
+#endif // RENDERSTATE_H
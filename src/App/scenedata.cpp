@@ -0,0 +1,495 @@
+#include "scenedata.h"
+#include "trace.h"
+#include "workerpool.h"
+
+#include <tinygltf/tiny_gltf.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+namespace
+{
+
+// tinygltf only defines the legacy GL texture formats.
+constexpr uint32_t g_formatRed = 0x1903;// GL_RED
+constexpr uint32_t g_formatRg = 0x8227; // GL_RG
+
+// Draws of skinned meshes point here until their node is known, see buildSceneData.
+constexpr uint32_t g_bindPoseNode = UINT32_MAX;
+// Index view of non-indexed primitives until the sequence is appended, see buildSceneData.
+constexpr int32_t g_sequenceBufferView = INT32_MIN;
+
+using MipChain = std::vector<std::vector<unsigned char>>;
+
+struct ParsedModelStorage
+{
+	std::shared_ptr<const tinygltf::Model> model;
+	std::vector<MipChain> mips;// generated levels of every image
+	std::vector<uint32_t> sequence;// 0, 1, 2, ... indices of the non-indexed primitives
+};
+
+uint32_t imageFormat(const tinygltf::Image & image)
+{
+	switch (image.component)
+	{
+		case 1:
+			return g_formatRed;
+		case 2:
+			return g_formatRg;
+		case 3:
+			return TINYGLTF_TEXTURE_FORMAT_RGB;
+		default:
+			return TINYGLTF_TEXTURE_FORMAT_RGBA;
+	}
+}
+
+uint32_t imageType(const tinygltf::Image & image)
+{
+	// The loader decodes to 8 or 16 bits per channel.
+	return image.bits == 16 ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT : TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+}
+
+// 2x2 box filter, odd edges are clamped.
+template <typename T>
+std::vector<unsigned char> downsample(const unsigned char * src, int width, int height, int components)
+{
+	const auto dstWidth = std::max(1, width / 2);
+	const auto dstHeight = std::max(1, height / 2);
+	std::vector<unsigned char> dst(static_cast<size_t>(dstWidth) * dstHeight * components * sizeof(T));
+
+	const auto * in = reinterpret_cast<const T *>(src);
+	auto * out = reinterpret_cast<T *>(dst.data());
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		const auto y0 = std::min(2 * y, height - 1);
+		const auto y1 = std::min(2 * y + 1, height - 1);
+		for (int x = 0; x < dstWidth; ++x)
+		{
+			const auto x0 = std::min(2 * x, width - 1);
+			const auto x1 = std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < components; ++c)
+			{
+				const uint32_t sum = in[(y0 * width + x0) * components + c]
+					+ in[(y0 * width + x1) * components + c]
+					+ in[(y1 * width + x0) * components + c]
+					+ in[(y1 * width + x1) * components + c];
+				out[(y * dstWidth + x) * components + c] = static_cast<T>((sum + 2) / 4);
+			}
+		}
+	}
+	return dst;
+}
+
+SceneData::Image buildImage(MipChain & mips, const tinygltf::Image & image)
+{
+	TRACE_SCOPE("buildImage");
+	SceneData::Image result{image.width, image.height, imageFormat(image), imageType(image), {}};
+	if (image.image.empty() || image.width <= 0 || image.height <= 0)
+	{
+		return result;
+	}
+
+	const auto components = std::max(1, image.component);
+	result.levels.emplace_back(image.image.data(), image.image.size());
+
+	auto width = image.width;
+	auto height = image.height;
+	const auto * level = image.image.data();
+	while (width > 1 || height > 1)
+	{
+		auto next = result.type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+			? downsample<uint16_t>(level, width, height, components)
+			: downsample<uint8_t>(level, width, height, components);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+
+		mips.push_back(std::move(next));
+		level = mips.back().data();
+		result.levels.emplace_back(level, mips.back().size());
+	}
+	return result;
+}
+
+void buildMesh(SceneData & scene, const tinygltf::Model & model, const tinygltf::Mesh & mesh)
+{
+	SceneData::Mesh result{static_cast<uint32_t>(scene.primitives.size()), 0};
+
+	for (const auto & primitive: mesh.primitives)
+	{
+		SceneData::Primitive record{
+			static_cast<uint32_t>(primitive.mode),
+			TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+			0,
+			g_sequenceBufferView,
+			0,
+			static_cast<uint32_t>(scene.attributes.size()),
+			0,
+			primitive.material,
+			{-FLT_MAX, -FLT_MAX, -FLT_MAX},
+			{FLT_MAX, FLT_MAX, FLT_MAX}};
+		if (primitive.indices >= 0)
+		{
+			const tinygltf::Accessor & indexAccessor = model.accessors[primitive.indices];
+			record.indexType = static_cast<uint32_t>(indexAccessor.componentType);
+			record.indexCount = static_cast<uint32_t>(indexAccessor.count);
+			record.indexBufferView = indexAccessor.bufferView;
+			record.indexOffset = indexAccessor.byteOffset;
+		}
+		else if (!primitive.attributes.empty())
+		{
+			// All attributes share the vertex count, drawn in order by the sequence.
+			record.indexCount = static_cast<uint32_t>(model.accessors[primitive.attributes.begin()->second].count);
+		}
+
+		for (const auto & [name, accessorIndex]: primitive.attributes)
+		{
+			int location = -1;
+			if (name == "POSITION") location = 0;
+			if (name == "NORMAL") location = 1;
+			if (name == "TEXCOORD_0") location = 2;
+			if (location < 0)
+			{
+				continue;// not read by the shaders, e.g. tangents or joints
+			}
+
+			const tinygltf::Accessor & accessor = model.accessors[accessorIndex];
+			if (location == 0 && accessor.minValues.size() == 3 && accessor.maxValues.size() == 3)
+			{
+				for (size_t axis = 0; axis < 3; ++axis)
+				{
+					record.boundsMin[axis] = static_cast<float>(accessor.minValues[axis]);
+					record.boundsMax[axis] = static_cast<float>(accessor.maxValues[axis]);
+				}
+			}
+			scene.attributes.push_back({
+				static_cast<uint32_t>(location),
+				accessor.type != TINYGLTF_TYPE_SCALAR ? accessor.type : 1,
+				static_cast<uint32_t>(accessor.componentType),
+				accessor.normalized ? 1u : 0u,
+				accessor.ByteStride(model.bufferViews[accessor.bufferView]),
+				accessor.bufferView,
+				accessor.byteOffset});
+			++record.attributeCount;
+		}
+
+		scene.primitives.push_back(record);
+		++result.primitiveCount;
+	}
+
+	scene.meshes.push_back(result);
+}
+
+int32_t textureImage(const tinygltf::Model & model, int texture)
+{
+	if (texture < 0 || static_cast<size_t>(texture) >= model.textures.size())
+	{
+		return -1;
+	}
+	const auto source = model.textures[texture].source;
+	return source >= 0 && static_cast<size_t>(source) < model.images.size() ? source : -1;
+}
+
+SceneData::Material buildMaterial(const tinygltf::Model & model, const tinygltf::Material & material)
+{
+	const auto & pbr = material.pbrMetallicRoughness;
+	SceneData::Material result{
+		textureImage(model, pbr.baseColorTexture.index),
+		textureImage(model, material.normalTexture.index),
+		textureImage(model, pbr.metallicRoughnessTexture.index),
+		{1.0f, 1.0f, 1.0f, 1.0f},
+		static_cast<float>(pbr.metallicFactor),
+		static_cast<float>(pbr.roughnessFactor),
+		static_cast<float>(material.normalTexture.scale)};
+	for (size_t i = 0; i < std::min<size_t>(result.baseColorFactor.size(), pbr.baseColorFactor.size()); ++i)
+	{
+		result.baseColorFactor[i] = static_cast<float>(pbr.baseColorFactor[i]);
+	}
+	return result;
+}
+
+// The node matrix if present, translation * rotation * scale otherwise.
+std::array<float, 16> localMatrix(const tinygltf::Node & node)
+{
+	std::array<float, 16> result{};
+	if (node.matrix.size() == 16)
+	{
+		std::transform(node.matrix.begin(), node.matrix.end(), result.begin(),
+					   [](const double value) { return static_cast<float>(value); });
+		return result;
+	}
+
+	const auto component = [](const std::vector<double> & values, size_t i, double fallback) {
+		return values.size() > i ? values[i] : fallback;
+	};
+	const auto x = component(node.rotation, 0, 0.0);
+	const auto y = component(node.rotation, 1, 0.0);
+	const auto z = component(node.rotation, 2, 0.0);
+	const auto w = component(node.rotation, 3, 1.0);
+	const std::array<double, 9> rotation{
+		1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + z * w), 2.0 * (x * z - y * w),
+		2.0 * (x * y - z * w), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + x * w),
+		2.0 * (x * z + y * w), 2.0 * (y * z - x * w), 1.0 - 2.0 * (x * x + y * y)};
+
+	for (size_t column = 0; column < 3; ++column)
+	{
+		const auto scale = component(node.scale, column, 1.0);
+		for (size_t row = 0; row < 3; ++row)
+		{
+			result[4 * column + row] = static_cast<float>(rotation[3 * column + row] * scale);
+		}
+		result[12 + column] = static_cast<float>(component(node.translation, column, 0.0));
+	}
+	result[15] = 1.0f;
+	return result;
+}
+
+// count * components floats of a float or normalized integer accessor, empty if it has another layout.
+std::vector<float> readFloats(const tinygltf::Model & model, int accessorIndex, size_t count, size_t components)
+{
+	if (accessorIndex < 0 || static_cast<size_t>(accessorIndex) >= model.accessors.size())
+	{
+		return {};
+	}
+	const tinygltf::Accessor & accessor = model.accessors[accessorIndex];
+	if (accessor.count != count || accessor.bufferView < 0
+		|| tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type)) != static_cast<int32_t>(components))
+	{
+		return {};
+	}
+
+	const tinygltf::BufferView & bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer & buffer = model.buffers[bufferView.buffer];
+	const auto componentSize = static_cast<size_t>(std::max(0, tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType))));
+	const auto stride = static_cast<size_t>(std::max(0, accessor.ByteStride(bufferView)));
+	if (componentSize == 0 || stride == 0)
+	{
+		return {};
+	}
+	const auto begin = bufferView.byteOffset + accessor.byteOffset;
+	const auto end = std::min(buffer.data.size(), bufferView.byteOffset + bufferView.byteLength);
+	if (count > 0 && begin + (count - 1) * stride + components * componentSize > end)
+	{
+		return {};
+	}
+
+	std::vector<float> result(count * components);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const unsigned char * element = buffer.data.data() + begin + i * stride;
+		for (size_t c = 0; c < components; ++c)
+		{
+			const unsigned char * bytes = element + c * componentSize;
+			auto & value = result[i * components + c];
+			switch (accessor.componentType)
+			{
+				case TINYGLTF_COMPONENT_TYPE_FLOAT:
+					std::memcpy(&value, bytes, sizeof(float));
+					break;
+				case TINYGLTF_COMPONENT_TYPE_BYTE:
+					value = std::max(static_cast<float>(static_cast<int8_t>(*bytes)) / 127.0f, -1.0f);
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+					value = static_cast<float>(*bytes) / 255.0f;
+					break;
+				case TINYGLTF_COMPONENT_TYPE_SHORT:
+				{
+					int16_t raw;
+					std::memcpy(&raw, bytes, sizeof(raw));
+					value = std::max(static_cast<float>(raw) / 32767.0f, -1.0f);
+					break;
+				}
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+				{
+					uint16_t raw;
+					std::memcpy(&raw, bytes, sizeof(raw));
+					value = static_cast<float>(raw) / 65535.0f;
+					break;
+				}
+				default:
+					return {};
+			}
+		}
+	}
+	return result;
+}
+
+// Local matrices of the EXT_mesh_gpu_instancing instances of node, relative
+// to the node. Empty without the extension or with unreadable attributes.
+std::vector<std::array<float, 16>> instanceMatrices(const tinygltf::Model & model, const tinygltf::Node & node)
+{
+	const auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+	if (extension == node.extensions.end() || !extension->second.Has("attributes"))
+	{
+		return {};
+	}
+
+	const auto & attributes = extension->second.Get("attributes");
+	const auto accessor = [&attributes](const char * name) {
+		return attributes.Has(name) ? attributes.Get(name).GetNumberAsInt() : -1;
+	};
+	const std::array<int, 3> accessors{accessor("TRANSLATION"), accessor("ROTATION"), accessor("SCALE")};
+
+	// All attributes share the count, take it from any present one.
+	size_t count = 0;
+	for (const auto index: accessors)
+	{
+		if (index >= 0 && static_cast<size_t>(index) < model.accessors.size())
+		{
+			count = model.accessors[index].count;
+		}
+	}
+
+	const auto translations = readFloats(model, accessors[0], count, 3);
+	const auto rotations = readFloats(model, accessors[1], count, 4);
+	const auto scales = readFloats(model, accessors[2], count, 3);
+	if ((accessors[0] >= 0 && translations.empty()) || (accessors[1] >= 0 && rotations.empty())
+		|| (accessors[2] >= 0 && scales.empty()))
+	{
+		std::cout << "WARN: unreadable EXT_mesh_gpu_instancing attributes, instances are skipped" << std::endl;
+		return {};
+	}
+
+	std::vector<std::array<float, 16>> result(count);
+	tinygltf::Node instance;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto range = [i](const std::vector<float> & values, size_t components) {
+			return values.empty() ? std::vector<double>{}
+								  : std::vector<double>(values.begin() + i * components, values.begin() + (i + 1) * components);
+		};
+		instance.translation = range(translations, 3);
+		instance.rotation = range(rotations, 4);
+		instance.scale = range(scales, 3);
+		result[i] = localMatrix(instance);
+	}
+	return result;
+}
+
+void buildNodes(SceneData & scene, const tinygltf::Model & model, int nodeIndex, int32_t parent)
+{
+	const tinygltf::Node & node = model.nodes[nodeIndex];
+	const auto index = static_cast<uint32_t>(scene.nodes.size());
+	scene.nodes.push_back({parent, localMatrix(node)});
+
+	if ((node.mesh >= 0) && (static_cast<size_t>(node.mesh) < model.meshes.size()))
+	{
+		const auto & mesh = scene.meshes[node.mesh];
+		const auto addDraws = [&scene, &mesh](uint32_t drawNode) {
+			for (uint32_t i = 0; i < mesh.primitiveCount; ++i)
+			{
+				scene.draws.push_back({drawNode, mesh.firstPrimitive + i});
+			}
+		};
+
+		// GPU instances become child nodes, drawn as instances like any repeated mesh.
+		const auto instances = node.skin < 0 ? instanceMatrices(model, node) : std::vector<std::array<float, 16>>{};
+		if (node.skin >= 0)
+		{
+			addDraws(g_bindPoseNode);
+		}
+		else if (instances.empty())
+		{
+			addDraws(index);
+		}
+		for (const auto & instance: instances)
+		{
+			addDraws(static_cast<uint32_t>(scene.nodes.size()));
+			scene.nodes.push_back({static_cast<int32_t>(index), instance});
+		}
+	}
+
+	for (const auto child: node.children)
+	{
+		assert((child >= 0) && (static_cast<size_t>(child) < model.nodes.size()));
+		buildNodes(scene, model, child, static_cast<int32_t>(index));
+	}
+}
+
+}// namespace
+
+SceneData buildSceneData(std::shared_ptr<const tinygltf::Model> model)
+{
+	TRACE_SCOPE("buildSceneData");
+	auto storage = std::make_shared<ParsedModelStorage>();
+	storage->model = model;
+
+	SceneData scene;
+	for (const auto & bufferView: model->bufferViews)
+	{
+		const tinygltf::Buffer & buffer = model->buffers[bufferView.buffer];
+		scene.bufferViews.push_back({
+			static_cast<uint32_t>(bufferView.target),
+			SceneData::Bytes(buffer.data.data() + bufferView.byteOffset, bufferView.byteLength)});
+	}
+
+	for (const auto & material: model->materials)
+	{
+		scene.materials.push_back(buildMaterial(*model, material));
+	}
+
+	for (const auto & mesh: model->meshes)
+	{
+		buildMesh(scene, *model, mesh);
+	}
+
+	// Non-indexed primitives draw a prefix of one shared 0, 1, 2, ... index
+	// view, so every primitive is drawn, culled and picked as indexed.
+	const auto sequenced = [](const SceneData::Primitive & primitive) { return primitive.indexBufferView == g_sequenceBufferView; };
+	if (std::any_of(scene.primitives.begin(), scene.primitives.end(), sequenced))
+	{
+		uint32_t sequenceLength = 1;
+		for (const auto & primitive: scene.primitives)
+		{
+			sequenceLength = sequenced(primitive) ? std::max(sequenceLength, primitive.indexCount) : sequenceLength;
+		}
+		storage->sequence.resize(sequenceLength);
+		std::iota(storage->sequence.begin(), storage->sequence.end(), 0u);
+		const auto view = static_cast<int32_t>(scene.bufferViews.size());
+		scene.bufferViews.push_back({
+			TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER,
+			SceneData::Bytes(reinterpret_cast<const unsigned char *>(storage->sequence.data()),
+							 storage->sequence.size() * sizeof(uint32_t))});
+		for (auto & primitive: scene.primitives)
+		{
+			primitive.indexBufferView = sequenced(primitive) ? view : primitive.indexBufferView;
+		}
+	}
+
+	if (!model->scenes.empty())
+	{
+		const auto sceneIndex = model->defaultScene >= 0 ? model->defaultScene : 0;
+		for (const auto node: model->scenes[sceneIndex].nodes)
+		{
+			assert((node >= 0) && (static_cast<size_t>(node) < model->nodes.size()));
+			buildNodes(scene, *model, node, -1);
+		}
+	}
+
+	// glTF ignores the transform of a skinned mesh node, its vertices are placed
+	// by the joints. Skinning is not implemented, so such draws get an identity
+	// root of their own and show the bind pose.
+	const auto skinned = [](const SceneData::Draw & draw) { return draw.node == g_bindPoseNode; };
+	if (std::any_of(scene.draws.begin(), scene.draws.end(), skinned))
+	{
+		const auto root = static_cast<uint32_t>(scene.nodes.size());
+		scene.nodes.push_back({-1, {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}});
+		for (auto & draw: scene.draws)
+		{
+			draw.node = skinned(draw) ? root : draw.node;
+		}
+	}
+
+	// Mip chains are independent, build them in parallel like the image decoding.
+	storage->mips.resize(model->images.size());
+	scene.images.resize(model->images.size());
+	WorkerPool::instance().parallelFor(model->images.size(), [&scene, &storage, &model](size_t i) {
+		scene.images[i] = buildImage(storage->mips[i], model->images[i]);
+	});
+
+	scene.storage = std::move(storage);
+	return scene;
+}
@@ -0,0 +1,114 @@
+#ifndef SCENEDATA_H
+#define SCENEDATA_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace tinygltf
+{
+struct Model;
+}
+
+// GPU-ready, flattened form of a glTF scene. Produced either from a parsed
+// tinygltf::Model or straight from a memory-mapped ModelCache file, so the GL
+// thread never needs the JSON DOM. Enum fields hold raw GL values (glTF uses
+// the same numbers), which keeps this header free of GL includes.
+struct SceneData
+{
+	using Bytes = std::span<const unsigned char>;
+
+	struct BufferView
+	{
+		uint32_t target;// GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER or 0 where glTF leaves it out
+		Bytes bytes;
+	};
+
+	struct Attribute
+	{
+		uint32_t location;// vertex attribute index used by the shaders
+		int32_t size;
+		uint32_t type;
+		uint32_t normalized;
+		int32_t stride;
+		int32_t bufferView;
+		uint64_t offset;
+	};
+
+	struct Primitive
+	{
+		uint32_t mode;
+		uint32_t indexType;
+		uint32_t indexCount;
+		int32_t indexBufferView;
+		uint64_t indexOffset;
+		uint32_t firstAttribute;
+		uint32_t attributeCount;
+		int32_t material;// -1 for the glTF default material
+		// POSITION accessor bounds, unbounded if the accessor has none.
+		std::array<float, 3> boundsMin;
+		std::array<float, 3> boundsMax;
+	};
+
+	// Texture fields are indices into images, -1 if the material has none.
+	struct Material
+	{
+		int32_t baseColorImage;
+		int32_t normalImage;
+		int32_t metallicRoughnessImage;
+		std::array<float, 4> baseColorFactor;
+		float metallicFactor;
+		float roughnessFactor;
+		float normalScale;
+	};
+
+	struct Mesh
+	{
+		uint32_t firstPrimitive;
+		uint32_t primitiveCount;
+	};
+
+	// One entry per node reachable from the default scene, in depth-first
+	// pre-order: parents precede their children, subtrees are contiguous.
+	struct Node
+	{
+		int32_t parent;// nodes index, -1 for scene roots
+		std::array<float, 16> local;// column-major, relative to the parent
+	};
+
+	// One entry per primitive reachable from the default scene, in traversal order.
+	struct Draw
+	{
+		uint32_t node;// nodes index
+		uint32_t primitive;
+	};
+
+	struct Image
+	{
+		int32_t width;
+		int32_t height;
+		uint32_t format;
+		uint32_t type;
+		std::vector<Bytes> levels;// full mip chain, levels[0] is the base image
+	};
+
+	std::vector<BufferView> bufferViews;
+	std::vector<Attribute> attributes;
+	std::vector<Primitive> primitives;
+	std::vector<Material> materials;
+	std::vector<Mesh> meshes;
+	std::vector<Node> nodes;
+	std::vector<Draw> draws;
+	std::vector<Image> images;
+
+	// Owns the memory all Bytes spans point into (a parsed model or a file mapping).
+	std::shared_ptr<const void> storage;
+};
+
+// Flattens model into SceneData and builds texture mip chains. The model is
+// kept alive as the storage of the returned scene.
+SceneData buildSceneData(std::shared_ptr<const tinygltf::Model> model);
+
+#endif // SCENEDATA_H
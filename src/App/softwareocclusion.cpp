@@ -0,0 +1,547 @@
+#include "softwareocclusion.h"
+#include "trace.h"
+#include "workerpool.h"
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SOFTWARE_OCCLUSION_SSE
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Primitives with more triangles cost more to rasterize than they save, and
+// the triangles rasterized per frame are capped over all occluders.
+constexpr uint32_t g_maxMeshTriangles = 2048;
+constexpr size_t g_maxTriangles = 16384;
+// Screen boxes smaller than this many depth buffer pixels hide too little to rasterize.
+constexpr float g_minOccluderArea = 256.0f;
+// Records projected or tested per worker pool job.
+constexpr size_t g_chunk = 256;
+constexpr int g_tilesX = SoftwareOcclusion::g_width / SoftwareOcclusion::g_tileWidth;
+constexpr int g_tilesY = SoftwareOcclusion::g_height / SoftwareOcclusion::g_tileHeight;
+
+static_assert(SoftwareOcclusion::g_width % SoftwareOcclusion::g_tileWidth == 0 &&
+			  SoftwareOcclusion::g_height % SoftwareOcclusion::g_tileHeight == 0);
+static_assert(SoftwareOcclusion::g_tileWidth % 4 == 0, "tiles are rasterized 4 pixels at a time");
+
+using Vec4 = std::array<float, 4>;
+
+Vec4 transform(const SoftwareOcclusion::Matrix & m, const float x, const float y, const float z)
+{
+	return {m[0] * x + m[4] * y + m[8] * z + m[12], m[1] * x + m[5] * y + m[9] * z + m[13],
+			m[2] * x + m[6] * y + m[10] * z + m[14], m[3] * x + m[7] * y + m[11] * z + m[15]};
+}
+
+// Points in front of the near plane, where the perspective divide is safe.
+bool inFront(const Vec4 & clip)
+{
+	return clip[2] >= -clip[3] && clip[3] > 1e-6f;
+}
+
+// Pixel coordinates of a clip position, y up, with its NDC depth.
+std::array<float, 3> toScreen(const Vec4 & clip)
+{
+	const auto inverseW = 1.0f / clip[3];
+	return {(clip[0] * inverseW * 0.5f + 0.5f) * static_cast<float>(SoftwareOcclusion::g_width),
+			(clip[1] * inverseW * 0.5f + 0.5f) * static_cast<float>(SoftwareOcclusion::g_height), clip[2] * inverseW};
+}
+
+// First and last pixel touched by the span [min, max) along an axis of size pixels, first > last if none.
+std::array<int, 2> pixelRange(const float min, const float max, const int size)
+{
+	const auto limit = static_cast<float>(size);
+	return {static_cast<int>(std::floor(std::clamp(min, 0.0f, limit))),
+			static_cast<int>(std::ceil(std::clamp(max, 0.0f, limit))) - 1};
+}
+
+size_t chunkCount(const size_t count)
+{
+	return (count + g_chunk - 1) / g_chunk;
+}
+
+}// namespace
+
+// Triangles of one primitive, views into the scene storage.
+struct SoftwareOcclusion::Mesh
+{
+	SceneData::Bytes positions;// from the first vertex
+	size_t stride;
+	SceneData::Bytes indices;// from the first index
+	uint32_t indexType;
+	uint32_t triangleCount;
+
+	[[nodiscard]] uint32_t index(const size_t i) const
+	{
+		switch (indexType)
+		{
+			case GL_UNSIGNED_BYTE:
+				return indices[i];
+			case GL_UNSIGNED_SHORT:
+			{
+				uint16_t value;
+				std::memcpy(&value, indices.data() + i * sizeof(value), sizeof(value));
+				return value;
+			}
+			default:
+			{
+				uint32_t value;
+				std::memcpy(&value, indices.data() + i * sizeof(value), sizeof(value));
+				return value;
+			}
+		}
+	}
+
+	[[nodiscard]] std::array<float, 3> position(const uint32_t vertex) const
+	{
+		std::array<float, 3> result;
+		std::memcpy(result.data(), positions.data() + vertex * stride, sizeof(result));
+		return result;
+	}
+};
+
+// Screen-space setup of an occluder triangle. Pixel (x, y) is covered if all
+// edge functions are >= 0 at its center, they are offset so this holds for the
+// whole pixel; the depth plane is offset to the furthest depth over the pixel.
+struct SoftwareOcclusion::Triangle
+{
+	std::array<float, 3> edgeA, edgeB, edgeC;// edge i is edgeA[i] * x + edgeB[i] * y + edgeC[i]
+	float depthA, depthB, depthC;
+	float maxDepth;// of the vertices, bounds the plane at the corners
+	int minX, minY, maxX, maxY;// inclusive pixel bounds, empty if minX > maxX
+};
+
+SoftwareOcclusion::SoftwareOcclusion()
+	: depth_(static_cast<size_t>(g_width) * g_height, 1.0f)
+	, tileMaxDepth_(static_cast<size_t>(g_tilesX) * g_tilesY, 1.0f)
+{
+	bins_.resize(tileMaxDepth_.size());
+}
+
+SoftwareOcclusion::~SoftwareOcclusion() = default;
+
+void SoftwareOcclusion::build(const SceneData & scene)
+{
+	TRACE_SCOPE("SoftwareOcclusion::build");
+	clear();
+	storage_ = scene.storage;
+	meshes_.resize(scene.primitives.size());
+
+	for (size_t i = 0; i < scene.primitives.size(); ++i)
+	{
+		const SceneData::Primitive & primitive = scene.primitives[i];
+		if (primitive.mode != GL_TRIANGLES || primitive.indexBufferView < 0 || primitive.indexCount < 3 ||
+			primitive.indexCount / 3 > g_maxMeshTriangles)
+		{
+			continue;
+		}
+
+		const SceneData::Attribute * position = nullptr;
+		for (uint32_t j = primitive.firstAttribute; j < primitive.firstAttribute + primitive.attributeCount; ++j)
+		{
+			if (scene.attributes[j].location == 0)
+			{
+				position = &scene.attributes[j];
+			}
+		}
+		if (!position || position->type != GL_FLOAT || position->size != 3 || position->stride <= 0 ||
+			position->bufferView < 0)
+		{
+			continue;
+		}
+
+		const auto positions = scene.bufferViews[position->bufferView].bytes;
+		const auto indices = scene.bufferViews[primitive.indexBufferView].bytes;
+		const size_t indexSize = primitive.indexType == GL_UNSIGNED_BYTE ? 1 : primitive.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		if (position->offset > positions.size() || primitive.indexOffset > indices.size() ||
+			primitive.indexCount * indexSize > indices.size() - primitive.indexOffset)
+		{
+			continue;
+		}
+
+		auto mesh = std::make_unique<Mesh>();
+		mesh->positions = positions.subspan(position->offset);
+		mesh->stride = static_cast<size_t>(position->stride);
+		mesh->indices = indices.subspan(primitive.indexOffset);
+		mesh->indexType = primitive.indexType;
+		mesh->triangleCount = primitive.indexCount / 3;
+
+		// Meshes are small, checking every index once spares the per-frame loop.
+		uint32_t maxIndex = 0;
+		for (size_t j = 0; j < 3 * static_cast<size_t>(mesh->triangleCount); ++j)
+		{
+			maxIndex = std::max(maxIndex, mesh->index(j));
+		}
+		if (maxIndex * mesh->stride + sizeof(float) * 3 <= mesh->positions.size())
+		{
+			meshes_[i] = std::move(mesh);
+		}
+	}
+}
+
+void SoftwareOcclusion::clear()
+{
+	meshes_.clear();
+	storage_.reset();
+	occluders_.clear();
+	triangles_.clear();
+}
+
+size_t SoftwareOcclusion::cull(const Matrix & viewProjection, std::span<const DrawRecord> records,
+							   std::span<const TransformHierarchy::Matrix> worlds, const BoxList & bounds,
+							   std::span<uint8_t> visible)
+{
+	TRACE_SCOPE("SoftwareOcclusion::cull");
+	assert(bounds.size() == records.size() && visible.size() == records.size());
+	auto & pool = WorkerPool::instance();
+
+	screenBoxes_.resize(records.size());
+	pool.parallelFor(chunkCount(records.size()), [&](const size_t chunk) {
+		const auto end = std::min(records.size(), (chunk + 1) * g_chunk);
+		for (size_t i = chunk * g_chunk; i < end; ++i)
+		{
+			if (!visible[i])
+			{
+				continue;
+			}
+			ScreenBox & screen = screenBoxes_[i];
+			screen = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, FLT_MAX, true};
+			const auto box = bounds.box(i);
+			for (size_t corner = 0; corner < 8 && screen.valid; ++corner)
+			{
+				const auto clip = transform(viewProjection, corner & 1 ? box.max[0] : box.min[0],
+											corner & 2 ? box.max[1] : box.min[1], corner & 4 ? box.max[2] : box.min[2]);
+				screen.valid = inFront(clip);
+				if (screen.valid)
+				{
+					// The projection is linear-fractional, its extremes over the box are at corners.
+					const auto [x, y, z] = toScreen(clip);
+					screen.minX = std::min(screen.minX, x);
+					screen.minY = std::min(screen.minY, y);
+					screen.maxX = std::max(screen.maxX, x);
+					screen.maxY = std::max(screen.maxY, y);
+					screen.minZ = std::min(screen.minZ, z);
+				}
+			}
+		}
+	});
+
+	selectOccluders(records, visible);
+	if (occluders_.empty())
+	{
+		std::fill(depth_.begin(), depth_.end(), 1.0f);
+		return 0;
+	}
+
+	setupTriangles(viewProjection, records, worlds);
+	binTriangles();
+	pool.parallelFor(bins_.size(), [this](const size_t tile) { rasterizeTile(tile); });
+
+	chunkOccluded_.assign(chunkCount(records.size()), 0);
+	pool.parallelFor(chunkOccluded_.size(), [&](const size_t chunk) {
+		const auto end = std::min(records.size(), (chunk + 1) * g_chunk);
+		for (size_t i = chunk * g_chunk; i < end; ++i)
+		{
+			if (visible[i] && screenBoxes_[i].valid && isOccluded(screenBoxes_[i]))
+			{
+				visible[i] = 0;
+				++chunkOccluded_[chunk];
+			}
+		}
+	});
+	return std::accumulate(chunkOccluded_.begin(), chunkOccluded_.end(), size_t{0});
+}
+
+void SoftwareOcclusion::selectOccluders(std::span<const DrawRecord> records, std::span<const uint8_t> visible)
+{
+	TRACE_SCOPE("SoftwareOcclusion::selectOccluders");
+	// Candidates by on-screen area, largest first.
+	std::vector<std::pair<float, uint32_t>> candidates;
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const ScreenBox & screen = screenBoxes_[i];
+		if (!visible[i] || !screen.valid || records[i].primitive >= meshes_.size() || !meshes_[records[i].primitive])
+		{
+			continue;
+		}
+		const auto width = std::clamp(screen.maxX, 0.0f, static_cast<float>(g_width)) -
+						   std::clamp(screen.minX, 0.0f, static_cast<float>(g_width));
+		const auto height = std::clamp(screen.maxY, 0.0f, static_cast<float>(g_height)) -
+							std::clamp(screen.minY, 0.0f, static_cast<float>(g_height));
+		if (width * height >= g_minOccluderArea)
+		{
+			candidates.emplace_back(width * height, static_cast<uint32_t>(i));
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const auto & a, const auto & b) { return a.first > b.first; });
+
+	occluders_.clear();
+	size_t triangleCount = 0;
+	for (const auto & [area, record]: candidates)
+	{
+		const auto meshTriangles = meshes_[records[record].primitive]->triangleCount;
+		if (triangleCount + meshTriangles > g_maxTriangles)
+		{
+			continue;
+		}
+		occluders_.push_back({record, triangleCount});
+		triangleCount += meshTriangles;
+	}
+	triangles_.resize(triangleCount);
+}
+
+void SoftwareOcclusion::setupTriangles(const Matrix & viewProjection, std::span<const DrawRecord> records,
+									   std::span<const TransformHierarchy::Matrix> worlds)
+{
+	TRACE_SCOPE("SoftwareOcclusion::setupTriangles");
+	WorkerPool::instance().parallelFor(occluders_.size(), [&](const size_t occluder) {
+		const auto [record, firstTriangle] = occluders_[occluder];
+		const Mesh & mesh = *meshes_[records[record].primitive];
+		Matrix clipFromModel;
+		multiplyMatrices(viewProjection, worlds[records[record].matrix], clipFromModel);
+
+		for (uint32_t t = 0; t < mesh.triangleCount; ++t)
+		{
+			Triangle & triangle = triangles_[firstTriangle + t];
+			triangle.minX = 1;
+			triangle.maxX = 0;
+
+			// Triangles reaching behind the near plane are skipped rather than clipped.
+			std::array<std::array<float, 3>, 3> screen;
+			auto inside = true;
+			for (size_t corner = 0; corner < 3 && inside; ++corner)
+			{
+				const auto [x, y, z] = mesh.position(mesh.index(3 * static_cast<size_t>(t) + corner));
+				const auto clip = transform(clipFromModel, x, y, z);
+				inside = inFront(clip);
+				screen[corner] = inside ? toScreen(clip) : std::array<float, 3>{};
+			}
+			if (!inside)
+			{
+				continue;
+			}
+
+			auto area = (screen[1][0] - screen[0][0]) * (screen[2][1] - screen[0][1]) -
+						(screen[2][0] - screen[0][0]) * (screen[1][1] - screen[0][1]);
+			// Either winding occludes, counter-clockwise keeps the edge functions positive inside.
+			if (area < 0.0f)
+			{
+				std::swap(screen[1], screen[2]);
+				area = -area;
+			}
+			if (area < 1e-6f)
+			{
+				continue;
+			}
+
+			for (size_t edge = 0; edge < 3; ++edge)
+			{
+				const auto & a = screen[edge];
+				const auto & b = screen[(edge + 1) % 3];
+				triangle.edgeA[edge] = a[1] - b[1];
+				triangle.edgeB[edge] = b[0] - a[0];
+				// At the pixel corner least inside the edge rather than at the center.
+				triangle.edgeC[edge] = a[0] * b[1] - a[1] * b[0] -
+									   0.5f * (std::abs(triangle.edgeA[edge]) + std::abs(triangle.edgeB[edge]));
+			}
+
+			const auto dz1 = screen[1][2] - screen[0][2];
+			const auto dz2 = screen[2][2] - screen[0][2];
+			triangle.depthA = (dz1 * (screen[2][1] - screen[0][1]) - dz2 * (screen[1][1] - screen[0][1])) / area;
+			triangle.depthB = ((screen[1][0] - screen[0][0]) * dz2 - (screen[2][0] - screen[0][0]) * dz1) / area;
+			triangle.depthC = screen[0][2] - triangle.depthA * screen[0][0] - triangle.depthB * screen[0][1] +
+							  0.5f * (std::abs(triangle.depthA) + std::abs(triangle.depthB));
+			triangle.maxDepth = std::max({screen[0][2], screen[1][2], screen[2][2]});
+
+			const auto [minX, maxX] = pixelRange(std::min({screen[0][0], screen[1][0], screen[2][0]}),
+												 std::max({screen[0][0], screen[1][0], screen[2][0]}), g_width);
+			const auto [minY, maxY] = pixelRange(std::min({screen[0][1], screen[1][1], screen[2][1]}),
+												 std::max({screen[0][1], screen[1][1], screen[2][1]}), g_height);
+			if (minY <= maxY)
+			{
+				triangle.minX = minX;
+				triangle.maxX = maxX;
+				triangle.minY = minY;
+				triangle.maxY = maxY;
+			}
+		}
+	});
+}
+
+void SoftwareOcclusion::binTriangles()
+{
+	TRACE_SCOPE("SoftwareOcclusion::binTriangles");
+	for (auto & bin: bins_)
+	{
+		bin.clear();
+	}
+	for (size_t i = 0; i < triangles_.size(); ++i)
+	{
+		const Triangle & triangle = triangles_[i];
+		if (triangle.minX > triangle.maxX)
+		{
+			continue;
+		}
+		for (int ty = triangle.minY / g_tileHeight; ty <= triangle.maxY / g_tileHeight; ++ty)
+		{
+			for (int tx = triangle.minX / g_tileWidth; tx <= triangle.maxX / g_tileWidth; ++tx)
+			{
+				bins_[static_cast<size_t>(ty * g_tilesX + tx)].push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+}
+
+void SoftwareOcclusion::rasterizeTile(const size_t tile)
+{
+	const auto tileX = static_cast<int>(tile % g_tilesX) * g_tileWidth;
+	const auto tileY = static_cast<int>(tile / g_tilesX) * g_tileHeight;
+	for (int y = tileY; y < tileY + g_tileHeight; ++y)
+	{
+		std::fill_n(depth_.data() + y * g_width + tileX, g_tileWidth, 1.0f);
+	}
+
+	for (const auto index: bins_[tile])
+	{
+		const Triangle & triangle = triangles_[index];
+		// Rows start on a 4 pixel boundary inside the tile, pixels left of the
+		// triangle fail its edge functions.
+		const auto minX = std::max(triangle.minX, tileX) & ~3;
+		const auto maxX = std::min(triangle.maxX, tileX + g_tileWidth - 1);
+		const auto minY = std::max(triangle.minY, tileY);
+		const auto maxY = std::min(triangle.maxY, tileY + g_tileHeight - 1);
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const auto centerY = static_cast<float>(y) + 0.5f;
+			float * row = depth_.data() + y * g_width;
+#ifdef SOFTWARE_OCCLUSION_SSE
+			__m128 edgeA[3];
+			__m128 edgeRow[3];
+			for (size_t edge = 0; edge < 3; ++edge)
+			{
+				edgeA[edge] = _mm_set1_ps(triangle.edgeA[edge]);
+				edgeRow[edge] = _mm_set1_ps(triangle.edgeB[edge] * centerY + triangle.edgeC[edge]);
+			}
+			const auto depthA = _mm_set1_ps(triangle.depthA);
+			const auto depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+			const auto maxDepth = _mm_set1_ps(triangle.maxDepth);
+			const auto zero = _mm_setzero_ps();
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				const auto centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+				auto covered = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), edgeRow[0]), zero);
+				covered = _mm_and_ps(covered, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], centerX), edgeRow[1]), zero));
+				covered = _mm_and_ps(covered, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], centerX), edgeRow[2]), zero));
+				if (_mm_movemask_ps(covered) == 0)
+				{
+					continue;
+				}
+				const auto depth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow), maxDepth);
+				const auto current = _mm_loadu_ps(row + x);
+				const auto nearer = _mm_min_ps(current, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearer), _mm_andnot_ps(covered, current)));
+			}
+#else
+			for (int x = minX; x <= maxX; ++x)
+			{
+				const auto centerX = static_cast<float>(x) + 0.5f;
+				auto covered = true;
+				for (size_t edge = 0; edge < 3; ++edge)
+				{
+					covered = covered &&
+							  triangle.edgeA[edge] * centerX + triangle.edgeB[edge] * centerY + triangle.edgeC[edge] >= 0.0f;
+				}
+				if (covered)
+				{
+					const auto depth = std::min(triangle.depthA * centerX + triangle.depthB * centerY + triangle.depthC,
+												triangle.maxDepth);
+					row[x] = std::min(row[x], depth);
+				}
+			}
+#endif
+		}
+	}
+
+	auto maxDepth = 0.0f;
+	for (int y = tileY; y < tileY + g_tileHeight; ++y)
+	{
+		const float * row = depth_.data() + y * g_width + tileX;
+		maxDepth = std::max(maxDepth, *std::max_element(row, row + g_tileWidth));
+	}
+	tileMaxDepth_[tile] = maxDepth;
+}
+
+bool SoftwareOcclusion::isOccluded(const ScreenBox & box) const
+{
+	const auto [minX, maxX] = pixelRange(box.minX, box.maxX, g_width);
+	const auto [minY, maxY] = pixelRange(box.minY, box.maxY, g_height);
+	// Off screen, the frustum test let it through conservatively; leave it to the GPU.
+	if (minX > maxX || minY > maxY)
+	{
+		return false;
+	}
+
+	for (int ty = minY / g_tileHeight; ty <= maxY / g_tileHeight; ++ty)
+	{
+		for (int tx = minX / g_tileWidth; tx <= maxX / g_tileWidth; ++tx)
+		{
+			// The whole tile is nearer than the box, no need to look at its pixels.
+			if (tileMaxDepth_[static_cast<size_t>(ty * g_tilesX + tx)] < box.minZ)
+			{
+				continue;
+			}
+
+			const auto rowMinX = std::max(minX, tx * g_tileWidth);
+			const auto rowMaxX = std::min(maxX, tx * g_tileWidth + g_tileWidth - 1);
+			const auto rowMinY = std::max(minY, ty * g_tileHeight);
+			const auto rowMaxY = std::min(maxY, ty * g_tileHeight + g_tileHeight - 1);
+			for (int y = rowMinY; y <= rowMaxY; ++y)
+			{
+				const float * row = depth_.data() + y * g_width;
+#ifdef SOFTWARE_OCCLUSION_SSE
+				const auto boxDepth = _mm_set1_ps(box.minZ);
+				const auto first = _mm_set1_ps(static_cast<float>(rowMinX));
+				const auto last = _mm_set1_ps(static_cast<float>(rowMaxX));
+				for (int x = rowMinX & ~3; x <= rowMaxX; x += 4)
+				{
+					const auto lane = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+					const auto inRange = _mm_and_ps(_mm_cmpge_ps(lane, first), _mm_cmple_ps(lane, last));
+					const auto open = _mm_and_ps(inRange, _mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth));
+					if (_mm_movemask_ps(open) != 0)
+					{
+						return false;
+					}
+				}
+#else
+				for (int x = rowMinX; x <= rowMaxX; ++x)
+				{
+					if (row[x] >= box.minZ)
+					{
+						return false;
+					}
+				}
+#endif
+			}
+		}
+	}
+	return true;
+}
+
+std::span<const float> SoftwareOcclusion::depth() const
+{
+	return depth_;
+}
+
+size_t SoftwareOcclusion::occluderTriangles() const
+{
+	return triangles_.size();
+}
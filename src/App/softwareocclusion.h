@@ -0,0 +1,96 @@
+#ifndef SOFTWAREOCCLUSION_H
+#define SOFTWAREOCCLUSION_H
+
+#include "frustumculling.h"
+#include "renderlist.h"
+#include "scenedata.h"
+#include "transformhierarchy.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Occlusion culling on the CPU, for frames not culled on the GPU. The draws
+// covering most of the screen whose primitive is low-poly enough are taken as
+// occluders and rasterized into a small depth buffer, one tile per worker pool
+// job; every other visible draw whose screen box lies behind that depth is
+// dropped. Coverage and depth are conservative per pixel (a pixel takes the
+// furthest depth of a triangle covering it entirely), so gaps between occluder
+// triangles only cost culling, never a visible draw. Uses SSE on x86 and
+// scalar code elsewhere. Occluders are rasterized in the rest pose, so morphed
+// frames must not be culled with it.
+class SoftwareOcclusion
+{
+public:
+	using Matrix = std::array<float, 16>;// column-major
+
+	// Depth buffer size and the tiles it is rasterized in.
+	static constexpr int g_width = 256;
+	static constexpr int g_height = 144;
+	static constexpr int g_tileWidth = 32;
+	static constexpr int g_tileHeight = 16;
+
+	SoftwareOcclusion();
+	~SoftwareOcclusion();
+
+	SoftwareOcclusion(const SoftwareOcclusion &) = delete;
+	SoftwareOcclusion & operator=(const SoftwareOcclusion &) = delete;
+
+	// Finds the triangle primitives of scene usable as occluders, dropping the
+	// previous scene. The scene itself may be destroyed afterwards, its storage is shared.
+	void build(const SceneData & scene);
+	void clear();
+
+	// Clears visible[i] of the visible records hidden behind the occluders
+	// among them and returns how many. bounds are the world boxes of records,
+	// worlds the node matrices DrawRecord::matrix indexes.
+	size_t cull(const Matrix & viewProjection, std::span<const DrawRecord> records,
+				std::span<const TransformHierarchy::Matrix> worlds, const BoxList & bounds, std::span<uint8_t> visible);
+
+	// Depth buffer of the last cull, NDC depth of g_width x g_height pixels,
+	// bottom row first; 1 where no occluder covers the pixel entirely.
+	[[nodiscard]] std::span<const float> depth() const;
+	// Occluder triangles rasterized by the last cull.
+	[[nodiscard]] size_t occluderTriangles() const;
+
+private:
+	struct Mesh;
+	struct Triangle;
+
+	// Screen rectangle of a record box in pixels with its nearest depth;
+	// invalid if the box reaches behind the near plane.
+	struct ScreenBox
+	{
+		float minX, minY, maxX, maxY;
+		float minZ;
+		bool valid;
+	};
+
+	struct Occluder
+	{
+		uint32_t record;
+		size_t firstTriangle;
+	};
+
+	void selectOccluders(std::span<const DrawRecord> records, std::span<const uint8_t> visible);
+	void setupTriangles(const Matrix & viewProjection, std::span<const DrawRecord> records,
+						std::span<const TransformHierarchy::Matrix> worlds);
+	void binTriangles();
+	void rasterizeTile(size_t tile);
+	[[nodiscard]] bool isOccluded(const ScreenBox & box) const;
+
+	std::shared_ptr<const void> storage_;
+	std::vector<std::unique_ptr<Mesh>> meshes_;// per primitive, null if it cannot occlude
+
+	std::vector<ScreenBox> screenBoxes_;// per record, of the visible ones only
+	std::vector<Occluder> occluders_;
+	std::vector<Triangle> triangles_;
+	std::vector<std::vector<uint32_t>> bins_;// triangles_ indices per tile
+	std::vector<float> depth_;
+	std::vector<float> tileMaxDepth_;
+	std::vector<size_t> chunkOccluded_;
+};
+
+#endif // SOFTWAREOCCLUSION_H
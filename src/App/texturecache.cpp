@@ -0,0 +1,100 @@
+#include "texturecache.h"
+
+#include <algorithm>
+#include <cassert>
+
+TextureCache::TextureCache(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+}
+
+TextureCache::~TextureCache()
+{
+	assert(images_.empty() && solids_.empty() && "TextureCache::release() must be called with a current context");
+}
+
+void TextureCache::upload(const size_t index, const SceneData::Image & image)
+{
+	if (index >= images_.size())
+	{
+		images_.resize(index + 1, 0);
+	}
+	if (images_[index] != 0 || image.levels.empty())
+	{
+		return;
+	}
+
+	GLuint texture = 0;
+	funcs_.glGenTextures(1, &texture);
+
+	funcs_.glBindTexture(GL_TEXTURE_2D, texture);
+	funcs_.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	funcs_.glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	funcs_.glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+
+	auto width = image.width;
+	auto height = image.height;
+	for (size_t level = 0; level < image.levels.size(); ++level)
+	{
+		funcs_.glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA, width, height, 0,
+							image.format, image.type, image.levels[level].data());
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	images_[index] = texture;
+}
+
+GLuint TextureCache::texture(const int32_t index, const Color fallback)
+{
+	if (index >= 0 && static_cast<size_t>(index) < images_.size() && images_[index] != 0)
+	{
+		return images_[index];
+	}
+	return solid(fallback);
+}
+
+void TextureCache::release()
+{
+	for (const auto texture: images_)
+	{
+		if (texture != 0)
+		{
+			funcs_.glDeleteTextures(1, &texture);
+		}
+	}
+	images_.clear();
+
+	for (const auto & [color, texture]: solids_)
+	{
+		funcs_.glDeleteTextures(1, &texture);
+	}
+	solids_.clear();
+}
+
+size_t TextureCache::size() const
+{
+	return solids_.size() + std::count_if(images_.begin(), images_.end(), [](GLuint texture) { return texture != 0; });
+}
+
+GLuint TextureCache::solid(const Color color)
+{
+	if (const auto it = solids_.find(color); it != solids_.end())
+	{
+		return it->second;
+	}
+
+	GLuint texture = 0;
+	funcs_.glGenTextures(1, &texture);
+	funcs_.glBindTexture(GL_TEXTURE_2D, texture);
+	funcs_.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	funcs_.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	funcs_.glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, color.data());
+
+	solids_.emplace(color, texture);
+	return texture;
+}
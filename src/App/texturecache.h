@@ -0,0 +1,46 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "glcallcounter.h"
+#include "scenedata.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// GL textures of the scene images. Every image is uploaded at most once no
+// matter how many materials sample it. Missing material textures resolve to
+// shared 1x1 textures of a constant color.
+class TextureCache
+{
+public:
+	using Color = std::array<uint8_t, 4>;
+
+	explicit TextureCache(GLCallCounter & funcs);
+	~TextureCache();
+
+	TextureCache(const TextureCache &) = delete;
+	TextureCache & operator=(const TextureCache &) = delete;
+
+	// Uploads the full mip chain of image unless it is already resident.
+	// Requires a current context, changes the GL_TEXTURE_2D binding.
+	void upload(size_t index, const SceneData::Image & image);
+
+	// Texture of an uploaded image, or the solid fallback if index is -1 or not uploaded.
+	GLuint texture(int32_t index, Color fallback);
+
+	// Deletes all textures. Requires a current context.
+	void release();
+
+	[[nodiscard]] size_t size() const;
+
+private:
+	GLuint solid(Color color);
+
+	GLCallCounter & funcs_;
+	std::vector<GLuint> images_;// indexed like SceneData::images, 0 if not uploaded
+	std::map<Color, GLuint> solids_;
+};
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,183 @@
+#include "trace.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+#ifdef APP_TRACING
+
+struct Event
+{
+	const char * name;
+	int64_t beginNs;
+	int64_t durationNs;
+};
+
+// Written by its thread only; the mutex is uncontended except while stop() copies it.
+struct ThreadBuffer
+{
+	std::mutex mutex;
+	std::vector<Event> events;
+	uint32_t threadId = 0;
+};
+
+struct Registry
+{
+	std::mutex mutex;
+	// Shared so a buffer survives the exit of its thread until it was written.
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+std::atomic<bool> g_recording{false};
+
+Registry & registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+ThreadBuffer & threadBuffer()
+{
+	thread_local const std::shared_ptr<ThreadBuffer> buffer = [] {
+		auto result = std::make_shared<ThreadBuffer>();
+		auto & reg = registry();
+		const std::lock_guard lock(reg.mutex);
+		result->threadId = static_cast<uint32_t>(reg.buffers.size()) + 1;
+		reg.buffers.push_back(result);
+		return result;
+	}();
+	return *buffer;
+}
+
+int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
+
+}// namespace
+
+namespace trace
+{
+
+#ifdef APP_TRACING
+
+bool available()
+{
+	return true;
+}
+
+void start()
+{
+	auto & reg = registry();
+	{
+		const std::lock_guard lock(reg.mutex);
+		for (const auto & buffer: reg.buffers)
+		{
+			const std::lock_guard bufferLock(buffer->mutex);
+			buffer->events.clear();
+		}
+	}
+	g_recording.store(true, std::memory_order_relaxed);
+}
+
+bool stop(const QString & path)
+{
+	g_recording.store(false, std::memory_order_relaxed);
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		std::cout << "Trace: failed to open " << path.toStdString() << std::endl;
+		return false;
+	}
+
+	// Chrome expects microseconds, relative to the first event keeps the numbers short.
+	auto & reg = registry();
+	const std::lock_guard lock(reg.mutex);
+	int64_t originNs = INT64_MAX;
+	for (const auto & buffer: reg.buffers)
+	{
+		const std::lock_guard bufferLock(buffer->mutex);
+		for (const auto & event: buffer->events)
+		{
+			originNs = std::min(originNs, event.beginNs);
+		}
+	}
+
+	QTextStream out(&file);
+	out.setRealNumberNotation(QTextStream::FixedNotation);
+	out.setRealNumberPrecision(3);// nanoseconds
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	size_t count = 0;
+	for (const auto & buffer: reg.buffers)
+	{
+		const std::lock_guard bufferLock(buffer->mutex);
+		for (const auto & event: buffer->events)
+		{
+			out << (count++ ? ",\n" : "\n") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"ts\": "
+				<< static_cast<double>(event.beginNs - originNs) / 1e3 << ", \"dur\": "
+				<< static_cast<double>(event.durationNs) / 1e3 << ", \"pid\": 1, \"tid\": " << buffer->threadId << '}';
+		}
+		buffer->events.clear();
+	}
+	out << "\n]}\n";
+
+	std::cout << "Trace: wrote " << count << " events to " << path.toStdString() << std::endl;
+	return out.status() == QTextStream::Ok;
+}
+
+Scope::Scope(const char * name) noexcept
+	: name_{g_recording.load(std::memory_order_relaxed) ? name : nullptr}
+{
+	if (name_)
+	{
+		beginNs_ = nowNs();
+	}
+}
+
+Scope::~Scope()
+{
+	if (!name_)
+	{
+		return;
+	}
+
+	const auto endNs = nowNs();
+	auto & buffer = threadBuffer();
+	const std::lock_guard lock(buffer.mutex);
+	buffer.events.push_back({name_, beginNs_, endNs - beginNs_});
+}
+
+#else
+
+bool available()
+{
+	return false;
+}
+
+void start()
+{
+}
+
+bool stop(const QString & /*path*/)
+{
+	return false;
+}
+
+#endif
+
+}// namespace trace
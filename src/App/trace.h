@@ -0,0 +1,50 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+
+#include <cstdint>
+
+// Scoped markers written as a Chrome trace (Trace Event Format), viewable in
+// chrome://tracing or ui.perfetto.dev. Markers are compiled in only with the
+// APP_ENABLE_TRACING CMake option; otherwise TRACE_SCOPE expands to nothing.
+// Every thread appends to its own buffer, so recording takes no shared lock.
+namespace trace
+{
+
+// True if the markers were compiled in.
+[[nodiscard]] bool available();
+
+// Starts recording, events stay in memory until stop().
+void start();
+// Stops recording and writes the events recorded so far to path.
+bool stop(const QString & path);
+
+#ifdef APP_TRACING
+class Scope
+{
+public:
+	// name must outlive the recording, in practice a string literal.
+	explicit Scope(const char * name) noexcept;
+	~Scope();
+
+	Scope(const Scope &) = delete;
+	Scope & operator=(const Scope &) = delete;
+
+private:
+	const char * name_;
+	int64_t beginNs_ = 0;
+};
+#endif
+
+}// namespace trace
+
+#ifdef APP_TRACING
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) const trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,205 @@
+#include "transformhierarchy.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRANSFORM_HIERARCHY_SSE
+#include <immintrin.h>
+#endif
+
+void multiplyMatrices(const TransformHierarchy::Matrix & a, const TransformHierarchy::Matrix & b,
+					  TransformHierarchy::Matrix & out)
+{
+#ifdef TRANSFORM_HIERARCHY_SSE
+	// Column j of the product is a combination of the columns of a weighted by column j of b.
+	const auto a0 = _mm_loadu_ps(a.data());
+	const auto a1 = _mm_loadu_ps(a.data() + 4);
+	const auto a2 = _mm_loadu_ps(a.data() + 8);
+	const auto a3 = _mm_loadu_ps(a.data() + 12);
+	for (size_t j = 0; j < 4; ++j)
+	{
+		const auto * column = b.data() + 4 * j;
+		auto result = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+		result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+		result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+		result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+		_mm_storeu_ps(out.data() + 4 * j, result);
+	}
+#else
+	for (size_t j = 0; j < 4; ++j)
+	{
+		for (size_t i = 0; i < 4; ++i)
+		{
+			out[4 * j + i] = a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1] + a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3];
+		}
+	}
+#endif
+}
+
+bool invertAffine(const TransformHierarchy::Matrix & m, TransformHierarchy::Matrix & out)
+{
+	// Element (row r, column c) is m[4 * c + r].
+	const auto cofactor00 = m[5] * m[10] - m[9] * m[6];
+	const auto cofactor01 = m[9] * m[2] - m[1] * m[10];
+	const auto cofactor02 = m[1] * m[6] - m[5] * m[2];
+	const auto determinant = m[0] * cofactor00 + m[4] * cofactor01 + m[8] * cofactor02;
+	if (determinant == 0.0f || !std::isfinite(determinant))
+	{
+		return false;
+	}
+
+	const auto inverse = 1.0f / determinant;
+	out = {
+		cofactor00 * inverse,
+		cofactor01 * inverse,
+		cofactor02 * inverse,
+		0.0f,
+		(m[8] * m[6] - m[4] * m[10]) * inverse,
+		(m[0] * m[10] - m[8] * m[2]) * inverse,
+		(m[4] * m[2] - m[0] * m[6]) * inverse,
+		0.0f,
+		(m[4] * m[9] - m[8] * m[5]) * inverse,
+		(m[8] * m[1] - m[0] * m[9]) * inverse,
+		(m[0] * m[5] - m[4] * m[1]) * inverse,
+		0.0f,
+		0.0f,
+		0.0f,
+		0.0f,
+		1.0f};
+	for (size_t r = 0; r < 3; ++r)
+	{
+		out[12 + r] = -(out[r] * m[12] + out[4 + r] * m[13] + out[8 + r] * m[14]);
+	}
+	return true;
+}
+
+Aabb transformBox(const Aabb & box, const TransformHierarchy::Matrix & m)
+{
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		if (box.min[axis] == -FLT_MAX || box.max[axis] == FLT_MAX)
+		{
+			return box;
+		}
+	}
+
+	Aabb result{{m[12], m[13], m[14]}, {m[12], m[13], m[14]}};
+	for (size_t c = 0; c < 3; ++c)
+	{
+		for (size_t r = 0; r < 3; ++r)
+		{
+			const auto low = m[4 * c + r] * box.min[c];
+			const auto high = m[4 * c + r] * box.max[c];
+			result.min[r] += std::min(low, high);
+			result.max[r] += std::max(low, high);
+		}
+	}
+	return result;
+}
+
+void TransformHierarchy::reset(std::span<const SceneData::Node> nodes)
+{
+	clear();
+	const auto count = nodes.size();
+	parents_.resize(count);
+	subtreeEnds_.resize(count);
+	locals_.resize(count);
+	worlds_.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		// A parent after its child cannot come from buildSceneData, treat such a node as a root.
+		const auto parent = nodes[i].parent;
+		parents_[i] = parent >= 0 && static_cast<size_t>(parent) < i ? parent : -1;
+		subtreeEnds_[i] = static_cast<uint32_t>(i + 1);
+		locals_[i] = nodes[i].local;
+	}
+	for (auto i = count; i-- > 0;)
+	{
+		if (parents_[i] >= 0)
+		{
+			auto & end = subtreeEnds_[static_cast<size_t>(parents_[i])];
+			end = std::max(end, subtreeEnds_[i]);
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (parents_[i] < 0)
+		{
+			dirtyRoots_.push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void TransformHierarchy::clear()
+{
+	parents_.clear();
+	subtreeEnds_.clear();
+	locals_.clear();
+	worlds_.clear();
+	dirtyRoots_.clear();
+}
+
+void TransformHierarchy::setLocal(const size_t node, const Matrix & local)
+{
+	assert(node < locals_.size());
+	locals_[node] = local;
+	dirtyRoots_.push_back(static_cast<uint32_t>(node));
+}
+
+bool TransformHierarchy::update()
+{
+	if (dirtyRoots_.empty())
+	{
+		return false;
+	}
+
+	TRACE_SCOPE("TransformHierarchy::update");
+	// Sorted, a root inside the range of an earlier one is its descendant and already covered.
+	std::sort(dirtyRoots_.begin(), dirtyRoots_.end());
+	uint32_t done = 0;
+	for (const auto root: dirtyRoots_)
+	{
+		if (root < done)
+		{
+			continue;
+		}
+
+		// Parents precede children, so each parent world is final when its children read it.
+		done = subtreeEnds_[root];
+		for (auto node = root; node < done; ++node)
+		{
+			const auto parent = parents_[node];
+			if (parent < 0)
+			{
+				worlds_[node] = locals_[node];
+			}
+			else
+			{
+				multiplyMatrices(worlds_[static_cast<size_t>(parent)], locals_[node], worlds_[node]);
+			}
+		}
+	}
+	dirtyRoots_.clear();
+	return true;
+}
+
+size_t TransformHierarchy::size() const
+{
+	return locals_.size();
+}
+
+auto TransformHierarchy::local(const size_t node) const -> const Matrix &
+{
+	return locals_[node];
+}
+
+auto TransformHierarchy::worlds() const -> std::span<const Matrix>
+{
+	return worlds_;
+}
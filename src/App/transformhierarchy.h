@@ -0,0 +1,53 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include "frustumculling.h"
+#include "scenedata.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Local and world matrices of the scene nodes, stored as parallel arrays in
+// the depth-first pre-order of SceneData::nodes: every parent precedes its
+// children and every subtree is a contiguous range. Changing a local matrix
+// only records the node; update() then rewrites the world matrices of the
+// recorded subtrees front to back and leaves the rest of the scene alone.
+class TransformHierarchy
+{
+public:
+	using Matrix = std::array<float, 16>;// column-major, like QMatrix4x4::constData()
+
+	// Takes the hierarchy and the local matrices of nodes, all marked dirty.
+	void reset(std::span<const SceneData::Node> nodes);
+	void clear();
+
+	void setLocal(size_t node, const Matrix & local);
+	// Recomputes the world matrices below every changed node. Returns false
+	// if nothing changed since the last call.
+	bool update();
+
+	[[nodiscard]] size_t size() const;
+	[[nodiscard]] const Matrix & local(size_t node) const;
+	[[nodiscard]] std::span<const Matrix> worlds() const;
+
+private:
+	std::vector<int32_t> parents_;// -1 for roots
+	std::vector<uint32_t> subtreeEnds_;// one past the last descendant
+	std::vector<Matrix> locals_;
+	std::vector<Matrix> worlds_;
+	std::vector<uint32_t> dirtyRoots_;// nodes whose local matrix changed
+};
+
+// out = a * b, out may alias neither input.
+void multiplyMatrices(const TransformHierarchy::Matrix & a, const TransformHierarchy::Matrix & b,
+					  TransformHierarchy::Matrix & out);
+// Inverse of an affine matrix (last row 0, 0, 0, 1). Returns false if it is singular.
+bool invertAffine(const TransformHierarchy::Matrix & matrix, TransformHierarchy::Matrix & out);
+// Box enclosing box after transforming it by the affine matrix (Arvo).
+// Unbounded boxes stay unbounded.
+Aabb transformBox(const Aabb & box, const TransformHierarchy::Matrix & matrix);
+
+#endif // TRANSFORMHIERARCHY_H
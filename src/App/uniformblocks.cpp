@@ -0,0 +1,79 @@
+#include "uniformblocks.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+UniformBlocks::UniformBlocks(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+}
+
+UniformBlocks::~UniformBlocks()
+{
+	assert(buffer_ == 0 && "UniformBlocks::release() must be called with a current context");
+}
+
+void UniformBlocks::create()
+{
+	GLint alignment = 0;
+	funcs_.glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	alignment = std::max(alignment, 1);
+	sceneOffset_ = (static_cast<GLintptr>(sizeof(CameraBlock)) + alignment - 1) / alignment * alignment;
+	staging_.assign(sceneOffset_ + sizeof(SceneBlock), 0);
+
+	funcs_.glGenBuffers(1, &buffer_);
+	funcs_.glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	funcs_.glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(staging_.size()), nullptr, GL_DYNAMIC_DRAW);
+	funcs_.glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	funcs_.glBindBufferRange(GL_UNIFORM_BUFFER, CameraBinding, buffer_, 0, sizeof(CameraBlock));
+	funcs_.glBindBufferRange(GL_UNIFORM_BUFFER, SceneBinding, buffer_, sceneOffset_, sizeof(SceneBlock));
+}
+
+void UniformBlocks::release()
+{
+	if (buffer_ != 0)
+	{
+		funcs_.glDeleteBuffers(1, &buffer_);
+		buffer_ = 0;
+	}
+}
+
+void UniformBlocks::attach(const GLuint program)
+{
+	const auto bind = [this, program](const char * name, Binding binding) {
+		const auto index = funcs_.glGetUniformBlockIndex(program, name);
+		if (index != GL_INVALID_INDEX)
+		{
+			funcs_.glUniformBlockBinding(program, index, binding);
+		}
+	};
+	bind("Camera", CameraBinding);
+	bind("Scene", SceneBinding);
+}
+
+void UniformBlocks::update(const CameraBlock * camera, const SceneBlock * scene)
+{
+	TRACE_SCOPE("UniformBlocks::update");
+	if (!camera && !scene)
+	{
+		return;
+	}
+
+	const GLintptr begin = camera ? 0 : sceneOffset_;
+	const GLintptr end = scene ? static_cast<GLintptr>(staging_.size()) : static_cast<GLintptr>(sizeof(CameraBlock));
+	if (camera)
+	{
+		std::memcpy(staging_.data(), camera, sizeof(*camera));
+	}
+	if (scene)
+	{
+		std::memcpy(staging_.data() + sceneOffset_, scene, sizeof(*scene));
+	}
+
+	funcs_.glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+	funcs_.glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, staging_.data() + begin);
+	funcs_.glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
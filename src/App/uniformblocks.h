@@ -0,0 +1,77 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include "glcallcounter.h"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Mirrors of the std140 uniform blocks declared in the shaders. vec3 members
+// take 16 bytes unless a float follows to fill the gap.
+struct CameraBlock
+{
+	std::array<float, 16> m;// column-major, like QMatrix4x4::constData()
+	std::array<float, 16> v;
+	std::array<float, 16> p;
+	std::array<float, 3> spotlightPosition;
+	float padding0;
+	std::array<float, 3> spotlightDirection;
+	float padding1;
+};
+
+struct SceneBlock
+{
+	std::array<float, 3> sunPosition;
+	float sunLightCoef;
+	std::array<float, 3> sunColor;
+	float ambientLightCoef;
+	std::array<float, 3> spotlightColor;
+	float spotlightCoef;
+	float spotlightFirstCos;
+	float spotlightSecondCos;
+	float morphingProgress;
+	float padding0;
+};
+
+static_assert(offsetof(CameraBlock, v) == 64 && offsetof(CameraBlock, p) == 128);
+static_assert(offsetof(CameraBlock, spotlightPosition) == 192 && offsetof(CameraBlock, spotlightDirection) == 208);
+static_assert(offsetof(SceneBlock, sunColor) == 16 && offsetof(SceneBlock, spotlightColor) == 32);
+static_assert(offsetof(SceneBlock, spotlightFirstCos) == 48 && offsetof(SceneBlock, morphingProgress) == 56);
+
+// Both blocks live in one uniform buffer at aligned offsets. Only blocks that
+// changed are written, both together with a single glBufferSubData.
+class UniformBlocks
+{
+public:
+	enum Binding : GLuint
+	{
+		CameraBinding,
+		SceneBinding
+	};
+
+	explicit UniformBlocks(GLCallCounter & funcs);
+	~UniformBlocks();
+
+	UniformBlocks(const UniformBlocks &) = delete;
+	UniformBlocks & operator=(const UniformBlocks &) = delete;
+
+	// Creates the buffer. Requires a current context.
+	void create();
+	// Deletes the buffer. Requires a current context.
+	void release();
+
+	// Points the blocks named "Camera" and "Scene" of program at the bindings.
+	void attach(GLuint program);
+
+	// Uploads the given blocks, nullptr keeps the contents on the GPU.
+	void update(const CameraBlock * camera, const SceneBlock * scene);
+
+private:
+	GLCallCounter & funcs_;
+	GLuint buffer_ = 0;
+	GLintptr sceneOffset_ = 0;
+	std::vector<unsigned char> staging_;// sized once by create()
+};
+
+#endif // UNIFORMBLOCKS_H
@@ -0,0 +1,39 @@
+#include "uploadqueue.h"
+
+void UploadQueue::push(size_t bytes, Job job)
+{
+	// Count every job as at least one byte so zero-sized jobs still advance progress.
+	bytes = bytes ? bytes : 1;
+	totalBytes_ += bytes;
+	jobs_.push_back({bytes, std::move(job)});
+}
+
+void UploadQueue::run(const size_t budgetBytes)
+{
+	size_t spent = 0;
+	while (!jobs_.empty() && (spent == 0 || spent < budgetBytes))
+	{
+		auto entry = std::move(jobs_.front());
+		jobs_.pop_front();
+		entry.job();
+		spent += entry.bytes;
+		doneBytes_ += entry.bytes;
+	}
+}
+
+void UploadQueue::clear()
+{
+	jobs_.clear();
+	totalBytes_ = 0;
+	doneBytes_ = 0;
+}
+
+bool UploadQueue::empty() const
+{
+	return jobs_.empty();
+}
+
+float UploadQueue::progress() const
+{
+	return totalBytes_ ? static_cast<float>(doneBytes_) / static_cast<float>(totalBytes_) : 1.0f;
+}
@@ -0,0 +1,40 @@
+#ifndef UPLOADQUEUE_H
+#define UPLOADQUEUE_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+
+// GL-thread work queue. Uploads are split into jobs and drained a few per frame,
+// so a large asset never stalls a single frame for the whole transfer.
+class UploadQueue
+{
+public:
+	using Job = std::function<void()>;
+
+	// bytes is an estimate of how much data the job transfers to the driver.
+	void push(size_t bytes, Job job);
+
+	// Runs jobs until budgetBytes is spent. At least one job runs per call so
+	// oversized jobs still make progress.
+	void run(size_t budgetBytes);
+
+	void clear();
+
+	[[nodiscard]] bool empty() const;
+	// Fraction of queued bytes already uploaded, in [0, 1].
+	[[nodiscard]] float progress() const;
+
+private:
+	struct Entry
+	{
+		size_t bytes;
+		Job job;
+	};
+
+	std::deque<Entry> jobs_;
+	size_t totalBytes_ = 0;
+	size_t doneBytes_ = 0;
+};
+
+#endif // UPLOADQUEUE_H
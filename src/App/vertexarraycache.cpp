@@ -0,0 +1,66 @@
+#include "vertexarraycache.h"
+
+#include <algorithm>
+#include <cassert>
+
+VertexArrayCache::VertexArrayCache(GLCallCounter & funcs)
+	: funcs_{funcs}
+{
+}
+
+VertexArrayCache::~VertexArrayCache()
+{
+	assert(vaos_.empty() && "VertexArrayCache::release() must be called with a current context");
+}
+
+GLuint VertexArrayCache::acquire(VertexLayout layout)
+{
+	std::sort(layout.begin(), layout.end());
+
+	if (const auto it = vaos_.find(layout); it != vaos_.end())
+	{
+		return it->second;
+	}
+
+	GLuint vao = 0;
+	funcs_.glGenVertexArrays(1, &vao);
+	funcs_.glBindVertexArray(vao);
+	for (const auto & binding: layout)
+	{
+		funcs_.glBindBuffer(GL_ARRAY_BUFFER, binding.buffer);
+		funcs_.glEnableVertexAttribArray(binding.location);
+		if (binding.integer)
+		{
+			funcs_.glVertexAttribIPointer(binding.location, binding.size, binding.type, binding.stride,
+										  reinterpret_cast<const void *>(binding.offset));
+		}
+		else
+		{
+			funcs_.glVertexAttribPointer(binding.location, binding.size, binding.type, binding.normalized,
+										 binding.stride, reinterpret_cast<const void *>(binding.offset));
+		}
+		if (binding.divisor != 0)
+		{
+			funcs_.glVertexAttribDivisor(binding.location, binding.divisor);
+		}
+	}
+	funcs_.glBindVertexArray(0);
+	funcs_.glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	vaos_.emplace(std::move(layout), vao);
+	return vao;
+}
+
+void VertexArrayCache::release()
+{
+	for (const auto & [layout, vao]: vaos_)
+	{
+		funcs_.glDeleteVertexArrays(1, &vao);
+	}
+	vaos_.clear();
+}
+
+size_t VertexArrayCache::size() const
+{
+	return vaos_.size();
+}
@@ -0,0 +1,54 @@
+#ifndef VERTEXARRAYCACHE_H
+#define VERTEXARRAYCACHE_H
+
+#include "glcallcounter.h"
+
+#include <compare>
+#include <map>
+#include <vector>
+
+// One vertex attribute resolved to a GL buffer name and absolute byte offset.
+struct VertexAttributeBinding
+{
+	GLuint location;
+	GLuint buffer;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	GLintptr offset;
+	GLuint divisor = 0;// advance per instance instead of per vertex if non-zero
+	bool integer = false;// read as int/uint through glVertexAttribIPointer, normalized is ignored
+
+	auto operator<=>(const VertexAttributeBinding &) const = default;
+};
+
+// Complete attribute setup of a draw. The order of bindings does not matter.
+using VertexLayout = std::vector<VertexAttributeBinding>;
+
+// Owns one VAO per distinct vertex layout, so primitives reading the same
+// vertex ranges share a VAO instead of each getting (or overwriting) one.
+class VertexArrayCache
+{
+public:
+	explicit VertexArrayCache(GLCallCounter & funcs);
+	~VertexArrayCache();
+
+	VertexArrayCache(const VertexArrayCache &) = delete;
+	VertexArrayCache & operator=(const VertexArrayCache &) = delete;
+
+	// Returns the VAO for layout, creating and configuring it on first use.
+	// Requires a current context. Leaves no VAO bound.
+	GLuint acquire(VertexLayout layout);
+
+	// Deletes all VAOs. Requires a current context.
+	void release();
+
+	[[nodiscard]] size_t size() const;
+
+private:
+	GLCallCounter & funcs_;
+	std::map<VertexLayout, GLuint> vaos_;
+};
+
+#endif // VERTEXARRAYCACHE_H
@@ -0,0 +1,110 @@
+#include "workerpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+WorkerPool::WorkerPool(const size_t threadCount)
+{
+	for (size_t i = 0; i < std::max<size_t>(1, threadCount); ++i)
+	{
+		threads_.emplace_back([this] { run(); });
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(mutex_);
+		stop_ = true;
+	}
+	wakeUp_.notify_all();
+	for (auto & thread: threads_)
+	{
+		thread.join();
+	}
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard lock(mutex_);
+		tasks_.push_back(std::move(task));
+	}
+	wakeUp_.notify_one();
+}
+
+void WorkerPool::parallelFor(const size_t count, std::function<void(size_t)> fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Shared with the helpers, which may start after this call already returned.
+	struct State
+	{
+		std::function<void(size_t)> fn;
+		size_t count;
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> done{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+	state->fn = std::move(fn);
+	state->count = count;
+
+	const auto work = [](State & s) {
+		for (size_t i = s.next++; i < s.count; i = s.next++)
+		{
+			s.fn(i);
+			if (++s.done == s.count)
+			{
+				std::lock_guard lock(s.mutex);
+				s.finished.notify_all();
+			}
+		}
+	};
+
+	const auto helpers = std::min(count - 1, threads_.size());
+	for (size_t i = 0; i < helpers; ++i)
+	{
+		submit([state, work] { work(*state); });
+	}
+
+	work(*state);
+
+	std::unique_lock lock(state->mutex);
+	state->finished.wait(lock, [&state] { return state->done == state->count; });
+}
+
+size_t WorkerPool::threadCount() const
+{
+	return threads_.size();
+}
+
+WorkerPool & WorkerPool::instance()
+{
+	static WorkerPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
+
+void WorkerPool::run()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock lock(mutex_);
+			wakeUp_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+			if (stop_ && tasks_.empty())
+			{
+				return;
+			}
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+		task();
+	}
+}
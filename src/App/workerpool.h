@@ -0,0 +1,43 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU-heavy jobs (image decoding, BVH builds...).
+class WorkerPool
+{
+public:
+	explicit WorkerPool(size_t threadCount);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool & operator=(const WorkerPool &) = delete;
+
+	void submit(std::function<void()> task);
+
+	// Runs fn(i) for every i in [0, count) and returns once all calls are done.
+	// The calling thread takes part, so nested calls from a worker cannot deadlock.
+	void parallelFor(size_t count, std::function<void(size_t)> fn);
+
+	[[nodiscard]] size_t threadCount() const;
+
+	// Process-wide pool with one thread per hardware thread.
+	static WorkerPool & instance();
+
+private:
+	void run();
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable wakeUp_;
+	std::deque<std::function<void()>> tasks_;
+	bool stop_ = false;
+};
+
+#endif // WORKERPOOL_H
@@ -1,5 +1,7 @@
 #include "GLWidget.hpp"
 
+#include <cmath>
+
 namespace fgl
 {
 
@@ -31,9 +33,9 @@ void GLWidget::initializeGL()
 
 void GLWidget::resizeGL(const int width, const int height)
 {
-	const auto retinaScale = devicePixelRatio();
-	onResize(static_cast<size_t>(width * retinaScale),
-			 static_cast<size_t>((height ? height : 1) * retinaScale));
+	const auto retinaScale = devicePixelRatioF();
+	onResize(static_cast<size_t>(std::lround(width * retinaScale)),
+			 static_cast<size_t>(std::lround((height ? height : 1) * retinaScale)));
 }
 
 void GLWidget::paintGL()